@@ -0,0 +1,258 @@
+// Host micro-benchmarks for the analyzer math, graph rendering and
+// persistence paths. Built against the shims in host/shims, see `make bench`.
+
+#include <chrono>
+
+#include "Arduino.h"
+#include "Complex.h"
+#include "Adafruit_TFTLCD.h"
+#include "RigExpertZeroII_I2C.h"
+
+// the sketch defines these before including graph.h
+#define BLACK   0x0000
+#define RED     0xF800
+#define GREEN   0x07E0
+#define MAGENTA 0xF81F
+#define YELLOW  0xFFE0
+#define WHITE   0xFFFF
+#define GRAY    0xBDF7
+
+#define TITLE_TEXT_SIZE 2
+#define LABEL_TEXT_SIZE 1
+
+#define MIN_FQ 100000
+#define MAX_FQ 1000000000
+#define MAX_STEPS 128
+
+Adafruit_TFTLCD tft(0, 0, 0, 0, 0);
+
+#include "analyzer.h"
+#include "frequency_plan.h"
+#include "sweep_buffer.h"
+#include "results.h"
+#include "graph.h"
+#include "persistence.h"
+
+struct BenchStats {
+    double ns_per_op;
+    double allocs_per_op;
+    double fs_calls_per_op;
+    DisplayCounters display;
+    uint32_t ops;
+};
+
+// run fn until at least min_ms have passed, each call counts as ops_per_call
+template<class F>
+BenchStats run_bench(size_t ops_per_call, F fn, uint32_t min_ms=200) {
+    // warm up
+    fn();
+
+    BenchStats stats;
+    size_t allocs_start = host_allocations;
+    size_t fs_calls_start = host_fs_calls;
+    tft.counters.reset();
+    uint32_t calls = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point now;
+    do {
+        for (int i = 0; i < 16; i++) {
+            fn();
+        }
+        calls += 16;
+        now = std::chrono::steady_clock::now();
+    } while (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() < min_ms);
+
+    double ops = (double)calls * ops_per_call;
+    stats.ns_per_op = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count() / ops;
+    stats.allocs_per_op = (host_allocations - allocs_start) / ops;
+    stats.fs_calls_per_op = (host_fs_calls - fs_calls_start) / ops;
+    stats.display = tft.counters;
+    stats.ops = calls * ops_per_call;
+    return stats;
+}
+
+void report(const char* name, const BenchStats& stats) {
+    printf("%-36s %12.1f ns/op %10.2f allocs/op", name, stats.ns_per_op, stats.allocs_per_op);
+    if (stats.display.calls + stats.display.lines + stats.display.fills > 0) {
+        printf(" %10.1f tft calls/op %10.1f px/op", (double)stats.display.calls / stats.ops, (double)stats.display.pixels / stats.ops);
+    }
+    if (stats.fs_calls_per_op > 0) {
+        printf(" %10.1f fs calls/op", stats.fs_calls_per_op);
+    }
+    printf("\n");
+}
+
+// keep results alive so the optimizer can't drop the work
+volatile float sink;
+
+uint32_t analysis_results_fq[MAX_STEPS];
+float analysis_results_re[MAX_STEPS];
+float analysis_results_im[MAX_STEPS];
+SweepBuffer analysis_results(analysis_results_fq, analysis_results_re, analysis_results_im, MAX_STEPS);
+CalibrationPoint calibration_results[MAX_STEPS];
+Analyzer analyzer(50, calibration_results);
+
+uint32_t plan_fqs[MAX_STEPS];
+uint16_t plan_calibration_idx[MAX_STEPS];
+FrequencyPlan plan(plan_fqs, plan_calibration_idx, MAX_STEPS);
+
+DerivedPoint derived_points[MAX_STEPS];
+DerivedResults derived(derived_points);
+
+// fill calibration and results with a full log sweep of the simulated load
+void setup_sweep() {
+    plan.initialize_log(MIN_FQ, MAX_FQ, MAX_STEPS);
+    for (size_t i = 0; i < plan.len(); i++) {
+        uint32_t fq = plan.fq(i);
+        // standards with a little frequency dependent error
+        float t = (float)i / plan.len();
+        calibration_results[i] = CalibrationPoint(fq, Complex(-0.98 + 0.01 * t, 0.02 * t), Complex(0.97 - 0.02 * t, -0.03 * t), Complex(0.01 * t, 0.005));
+        analysis_results.set(i, fq, analyzer.uncalibrated_measure(fq));
+    }
+    analysis_results.len_ = plan.len();
+    analyzer.calibration_len_ = plan.len();
+    analyzer.calibration_changed();
+    plan.relate(&analyzer);
+    derived.update(analysis_results, 1, &analyzer, &plan);
+}
+
+void bench_math() {
+    const CalibrationPoint& cal = calibration_results[MAX_STEPS/2];
+    Complex g(0.3, -0.2);
+
+    report("calibrate_reflection (standards)", run_bench(1, [&]() {
+        sink = calibrate_reflection(cal.cal_short, cal.cal_open, cal.cal_load, g).real();
+    }));
+
+    report("CalibrationPoint::calibrate (solved)", run_bench(1, [&]() {
+        sink = cal.calibrate(g).real();
+    }));
+
+    report("compute_swr", run_bench(1, [&]() {
+        sink = compute_swr(g);
+    }));
+
+    // off-grid frequencies force interpolation
+    analyzer.interpolation_ = CAL_INTERP_LINEAR;
+    report("calibrated_gamma linear interp", run_bench(MAX_STEPS, [&]() {
+        for (size_t i = 0; i < MAX_STEPS; i++) {
+            sink = analyzer.calibrated_gamma(analysis_results[i].fq + 1, analysis_results[i].uncal_z).real();
+        }
+    }));
+    analyzer.interpolation_ = CAL_INTERP_CUBIC;
+    report("calibrated_gamma cubic interp", run_bench(MAX_STEPS, [&]() {
+        for (size_t i = 0; i < MAX_STEPS; i++) {
+            sink = analyzer.calibrated_gamma(analysis_results[i].fq + 1, analysis_results[i].uncal_z).real();
+        }
+    }));
+    analyzer.interpolation_ = CAL_INTERP_LINEAR;
+
+    float gamma_re[MAX_STEPS];
+    float gamma_im[MAX_STEPS];
+    report("calibrate_sweep on grid", run_bench(MAX_STEPS, [&]() {
+        calibrate_sweep(&analyzer, analysis_results, &plan, gamma_re, gamma_im);
+        sink = gamma_re[MAX_STEPS-1];
+    }));
+    report("calibrate_sweep no plan", run_bench(MAX_STEPS, [&]() {
+        calibrate_sweep(&analyzer, analysis_results, NULL, gamma_re, gamma_im);
+        sink = gamma_re[MAX_STEPS-1];
+    }));
+
+    uint32_t generation = 100;
+    report("DerivedResults::update (per point)", run_bench(MAX_STEPS, [&]() {
+        derived.update(analysis_results, generation++, &analyzer, &plan);
+    }));
+    report("DerivedResults::update no plan", run_bench(MAX_STEPS, [&]() {
+        derived.update(analysis_results, generation++, &analyzer);
+    }));
+    derived.update(analysis_results, generation++, &analyzer, &plan);
+}
+
+void bench_graph() {
+    tft.setRotation(3);
+
+    GraphContext swr(derived, &analyzer);
+    swr.initialize_swr();
+    report("GraphContext::graph_swr", run_bench(1, [&]() {
+        swr.graph_swr();
+    }));
+    report("swr pointer tick", run_bench(1, [&]() {
+        swr.incr_swri(1);
+        swr.draw_swr_pointer();
+        swr.draw_swr_title();
+    }));
+
+    GraphContext smith(derived, &analyzer);
+    smith.initialize_smith(true);
+    report("GraphContext::graph_smith", run_bench(1, [&]() {
+        smith.graph_smith();
+    }));
+    report("smith pointer tick", run_bench(1, [&]() {
+        smith.incr_swri(1);
+        smith.draw_smith_pointer();
+        smith.draw_smith_title();
+    }));
+}
+
+void bench_persistence() {
+    AnalyzerPersistence persistence;
+    if (!persistence.begin()) {
+        printf("persistence failed to begin\n");
+        return;
+    }
+
+    report("save_results json 128 points", run_bench(1, [&]() {
+        persistence.save_results("bench.json", &analysis_results, &analyzer);
+    }));
+    uint32_t loaded_fq[MAX_STEPS];
+    float loaded_re[MAX_STEPS];
+    float loaded_im[MAX_STEPS];
+    SweepBuffer loaded(loaded_fq, loaded_re, loaded_im, MAX_STEPS);
+    report("load_results json 128 points", run_bench(1, [&]() {
+        persistence.load_results("bench.json", &loaded);
+    }));
+
+    report("save_settings json 128 points", run_bench(1, [&]() {
+        persistence.save_settings("bench.json", &analyzer);
+    }));
+    CalibrationPoint loaded_cal[MAX_STEPS];
+    Analyzer loaded_analyzer(50, loaded_cal);
+    report("load_settings json 128 points", run_bench(1, [&]() {
+        persistence.load_settings("bench.json", &loaded_analyzer, MAX_STEPS);
+    }));
+
+    report("save_results binary 128 points", run_bench(1, [&]() {
+        persistence.save_results("bench.bin", &analysis_results, &analyzer);
+    }));
+    report("load_results binary 128 points", run_bench(1, [&]() {
+        persistence.load_results("bench.bin", &loaded);
+    }));
+    report("save_settings binary 128 points", run_bench(1, [&]() {
+        persistence.save_settings("bench.bin", &analyzer);
+    }));
+    report("load_settings binary 128 points", run_bench(1, [&]() {
+        persistence.load_settings("bench.bin", &loaded_analyzer, MAX_STEPS);
+    }));
+
+    // naming and finding the latest file with a directory that's seen some
+    // use, these shouldn't grow with the file count
+    char name[32];
+    for (int i = 0; i < 200; i++) {
+        snprintf(name, sizeof(name), "results_%d.bin", i);
+        persistence.save_results(name, &analysis_results, &analyzer);
+    }
+    report("save_results auto named 200 files", run_bench(1, [&]() {
+        persistence.save_results(&analysis_results, &analyzer);
+    }, 50));
+    report("load_results latest 200+ files", run_bench(1, [&]() {
+        persistence.load_results(&loaded);
+    }));
+}
+
+int main(int argc, char* argv[]) {
+    setup_sweep();
+    bench_math();
+    bench_graph();
+    bench_persistence();
+    return 0;
+}
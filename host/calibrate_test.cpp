@@ -0,0 +1,168 @@
+// Walks the Calibrator through full and partial calibrations against the
+// simulated Zero II and checks where every calibration point ends up.
+// Built by `make test`.
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "Complex.h"
+#include "Adafruit_TFTLCD.h"
+#include "RigExpertZeroII_I2C.h"
+
+// the sketch defines these before including process.h
+#define BLACK   0x0000
+#define RED     0xF800
+#define GREEN   0x07E0
+#define MAGENTA 0xF81F
+#define YELLOW  0xFFE0
+#define WHITE   0xFFFF
+#define GRAY    0xBDF7
+
+#define TITLE_TEXT_SIZE 2
+#define LABEL_TEXT_SIZE 1
+#define MENU_ORIG_X 0
+#define MENU_ORIG_Y TITLE_TEXT_SIZE*8*2
+#define CONFIRM_ORIG_X TITLE_TEXT_SIZE*6
+#define CONFIRM_ORIG_Y TITLE_TEXT_SIZE*8*3
+
+#define MIN_FQ 100000
+#define MAX_FQ 1000000000
+#define MAX_STEPS 64
+
+Adafruit_TFTLCD tft(0, 0, 0, 0, 0);
+
+#include "analyzer.h"
+#include "frequency_plan.h"
+#include "sweep_buffer.h"
+#include "results.h"
+#include "graph.h"
+#include "menu_manager.h"
+#include "persistence.h"
+
+CalibrationPoint calibration_results[MAX_STEPS];
+Analyzer analyzer(50, calibration_results);
+
+uint32_t plan_fqs[MAX_STEPS];
+uint16_t plan_calibration_idx[MAX_STEPS];
+FrequencyPlan plan(plan_fqs, plan_calibration_idx, MAX_STEPS);
+
+uint32_t analysis_results_generation = 0;
+DerivedPoint derived_points[MAX_STEPS];
+DerivedResults derived_results(derived_points);
+
+int32_t turn = 0;
+bool click = true;
+
+void draw_title() {}
+void initialize_progress_meter(String label) {}
+void draw_progress_meter(size_t total, size_t current, size_t min_value=0) {}
+void clear_menu(Menu* current_menu, int16_t menu_x=MENU_ORIG_X, int16_t menu_y=MENU_ORIG_Y) {}
+void draw_menu(Menu* current_menu, int current_option, bool fresh=true, int16_t menu_x=MENU_ORIG_X, int16_t menu_y=MENU_ORIG_Y) {}
+
+// band_names keeps F() strings in a const char* table, which only the
+// board's core accepts
+#undef F
+#define F(string_literal) (string_literal)
+#include "process.h"
+
+int failures = 0;
+
+void check(bool ok, const char* what, size_t i) {
+    if (!ok) {
+        printf("FAIL %s at %zu\n", what, i);
+        failures++;
+    }
+}
+
+// kept points carry this short so we can tell them from measured ones
+const Complex kept_short(-0.5, 0.25);
+
+// an old calibration at fqs, with the load the simulated analyzer will
+// read so kept points pass the spot check
+void fill_calibration(const uint32_t* fqs, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        Complex load = compute_gamma(analyzer.uncalibrated_measure(fqs[i]), analyzer.z0_);
+        calibration_results[i] = CalibrationPoint(fqs[i], kept_short, Complex(1), load);
+    }
+    analyzer.calibration_len_ = len;
+    analyzer.calibration_changed();
+}
+
+// run a calibration of plan_list to completion like the menu does and
+// check every plan point is present, in order, and kept only if expected
+void check_calibration(const char* name, const uint32_t* plan_list, size_t len, bool partial, size_t expected_kept, size_t expected_measurements) {
+    plan.initialize_list(plan_list, len);
+    plan.relate(&analyzer);
+    Calibrator calibrator(&analyzer);
+    calibrator.initialize(&plan, calibration_results, partial);
+    uint32_t measurements = analyzer.zeroii_.measurements_;
+    size_t steps = 0;
+    while (!calibrator.calibration_step()) {
+        steps++;
+        check(steps < 1000, name, steps);
+        if (steps >= 1000) {
+            return;
+        }
+    }
+    analyzer.calibration_len_ = len;
+    analyzer.calibration_changed();
+
+    size_t kept = 0;
+    for (size_t i = 0; i < len; i++) {
+        check(calibration_results[i].fq == plan_list[i], name, i);
+        if (calibration_results[i].cal_short == kept_short) {
+            kept++;
+        }
+    }
+    check(kept == expected_kept, name, kept);
+    check(analyzer.zeroii_.measurements_ - measurements == expected_measurements, name, expected_measurements);
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t fqs[MAX_STEPS];
+    uint32_t old_fqs[MAX_STEPS];
+
+    // a full calibration measures every standard at every point
+    for (size_t i = 0; i < 10; i++) {
+        fqs[i] = 1000000 * (i + 1);
+    }
+    check_calibration("full", fqs, 10, false, 0, 30);
+
+    // new points at both ends of 8 kept ones, the kept points move up one.
+    // one spot check, then the 2 new points for each standard.
+    for (size_t i = 0; i < 8; i++) {
+        old_fqs[i] = fqs[i + 1];
+    }
+    fill_calibration(old_fqs, 8);
+    check_calibration("new at both ends", fqs, 10, true, 8, 1 + 2*3);
+
+    // 16 kept points, some old points dropped so kept ones move down, new
+    // points interleaved and trailing
+    for (size_t i = 0; i < 24; i++) {
+        old_fqs[i] = 1000000 * (i + 1);
+    }
+    fill_calibration(old_fqs, 24);
+    size_t len = 0;
+    for (size_t i = 4; i < 20; i++) {
+        fqs[len++] = old_fqs[i];
+        if (i % 5 == 0) {
+            fqs[len++] = old_fqs[i] + 500000;
+        }
+    }
+    fqs[len++] = 30000000;
+    fqs[len++] = 31000000;
+    check_calibration("kept multiple of stride", fqs, len, true, 16, 2 + (len - 16)*3);
+
+    // a drifted load at the second spot check throws away the kept points
+    // around it
+    fill_calibration(fqs, len);
+    calibration_results[CAL_CHECK_STRIDE + CAL_CHECK_STRIDE/2].cal_load = Complex(0.5, 0.5);
+    check_calibration("drift", fqs, len, true, len - CAL_CHECK_STRIDE, (len + CAL_CHECK_STRIDE - 1) / CAL_CHECK_STRIDE + CAL_CHECK_STRIDE*3);
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("calibrator ok\n");
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Definitions backing the host shims: clock, number formatting, the
+// in-memory filesystem and allocation counting.
+
+#include <chrono>
+#include <new>
+
+#include "Arduino.h"
+#include "SdFat.h"
+
+size_t host_allocations = 0;
+
+void* operator new(size_t size) {
+    host_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+HostSerial Serial;
+
+HostFs host_fs;
+size_t host_fs_calls = 0;
+
+static struct HostFsInit {
+    HostFsInit() {
+        host_fs["/"].is_dir = true;
+    }
+} host_fs_init;
+
+static std::chrono::steady_clock::time_point host_start = std::chrono::steady_clock::now();
+
+uint32_t millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - host_start).count();
+}
+
+uint32_t micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - host_start).count();
+}
+
+void delay(uint32_t ms) {
+}
+
+void delayMicroseconds(uint32_t us) {
+}
+
+char* utoa(unsigned value, char* str, int base) {
+    char tmp[34];
+    int i = 0;
+    do {
+        int d = value % base;
+        tmp[i++] = d < 10 ? '0' + d : 'a' + d - 10;
+        value /= base;
+    } while (value);
+    int j = 0;
+    while (i) {
+        str[j++] = tmp[--i];
+    }
+    str[j] = 0;
+    return str;
+}
+
+char* itoa(int value, char* str, int base) {
+    if (value < 0 && base == 10) {
+        str[0] = '-';
+        utoa(-(unsigned)value, str + 1, base);
+        return str;
+    }
+    return utoa((unsigned)value, str, base);
+}
+
+char* dtostrf(double val, signed char width, unsigned char prec, char* buf) {
+    sprintf(buf, "%*.*f", width, prec, val);
+    return buf;
+}
@@ -0,0 +1,305 @@
+// Checks JsonTokenizer against the String based JsonStreamingParser it
+// replaced: both must report the same events for the same bytes, and numbers
+// must convert to the same bits as atof()/atoi() did. Also reports parse
+// throughput for both. Run by `make test`.
+
+#include <chrono>
+#include <string>
+
+#include "Arduino.h"
+#include "Complex.h"
+#include "JsonListener.h"
+#include "JsonStreamingParser.h"
+#include "RigExpertZeroII_I2C.h"
+
+#define MAX_STEPS 128
+
+#include "analyzer.h"
+#include "sweep_buffer.h"
+#include "persistence.h"
+
+int failures = 0;
+
+void check(bool ok, const char* what, const char* detail) {
+    if (!ok) {
+        printf("FAIL %s: %s\n", what, detail);
+        failures++;
+    }
+}
+
+bool same_bits(float a, float b) {
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// records events from the old parser, values the way the listeners used to
+// convert them
+class ReferenceRecorder : public JsonListener {
+public:
+    void whitespace(char c) {}
+    void startDocument() { events += "D"; }
+    void endDocument() { events += "d"; }
+    void startObject() { events += "{"; }
+    void endObject() { events += "}"; }
+    void startArray() { events += "["; }
+    void endArray() { events += "]"; }
+    void key(String k) { events += "k:" + std::string(k.c_str()) + ";"; }
+    void value(String v) {
+        char buf[64];
+        float f = atof(v.c_str());
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        snprintf(buf, sizeof(buf), "v:%s=%08x/%ld;", v.c_str(), bits, (long)atoi(v.c_str()));
+        events += buf;
+    }
+
+    std::string events;
+};
+
+class TokenizerRecorder {
+public:
+    void startDocument() { events += "D"; }
+    void endDocument() { events += "d"; }
+    void startObject() { events += "{"; }
+    void endObject() { events += "}"; }
+    void startArray() { events += "["; }
+    void endArray() { events += "]"; }
+    void key(const JsonValue &k) { events += "k:" + std::string(k.text_) + ";"; }
+    void value(const JsonValue &v) {
+        char buf[64];
+        float f = v.to_float();
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        snprintf(buf, sizeof(buf), "v:%s=%08x/%ld;", v.text_, bits, v.to_long());
+        events += buf;
+    }
+
+    std::string events;
+};
+
+// listeners that do nothing, for timing the parsers alone
+class NullListener : public JsonListener {
+public:
+    void whitespace(char c) {}
+    void startDocument() {}
+    void endDocument() {}
+    void startObject() {}
+    void endObject() {}
+    void startArray() {}
+    void endArray() {}
+    void key(String k) {}
+    void value(String v) {}
+};
+
+class NullTokenizerListener {
+public:
+    void startDocument() {}
+    void endDocument() {}
+    void startObject() {}
+    void endObject() {}
+    void startArray() {}
+    void endArray() {}
+    void key(const JsonValue &k) {}
+    void value(const JsonValue &v) {}
+};
+
+void check_same_events(const char* what, const std::string &doc) {
+    ReferenceRecorder reference;
+    JsonStreamingParser parser;
+    parser.setListener(&reference);
+    TokenizerRecorder recorder;
+    JsonTokenizer tokenizer;
+    for (size_t i = 0; i < doc.size(); i++) {
+        parser.parse(doc[i]);
+        tokenizer.parse(doc[i], &recorder);
+    }
+    check(!tokenizer.has_error_, what, "tokenizer error");
+    check(recorder.events == reference.events, what, recorder.events.c_str());
+}
+
+std::string read_file(FsFile* dir, const char* name) {
+    FsFile entry;
+    std::string doc;
+    if (!entry.open(dir, name, O_RDONLY)) {
+        return doc;
+    }
+    int c;
+    while ((c = entry.read()) >= 0) {
+        doc += (char)c;
+    }
+    entry.close();
+    return doc;
+}
+
+uint32_t fqs[MAX_STEPS];
+float res[MAX_STEPS];
+float ims[MAX_STEPS];
+uint8_t samples[MAX_STEPS];
+uint8_t segments[MAX_STEPS];
+SweepBuffer results(fqs, res, ims, MAX_STEPS, samples, segments);
+
+CalibrationPoint calibration[MAX_STEPS];
+Analyzer analyzer(50, calibration);
+
+uint32_t loaded_fqs[MAX_STEPS];
+float loaded_res[MAX_STEPS];
+float loaded_ims[MAX_STEPS];
+uint8_t loaded_samples[MAX_STEPS];
+uint8_t loaded_segments[MAX_STEPS];
+SweepBuffer loaded(loaded_fqs, loaded_res, loaded_ims, MAX_STEPS, loaded_samples, loaded_segments);
+
+CalibrationPoint loaded_calibration[MAX_STEPS];
+Analyzer loaded_analyzer(75, loaded_calibration);
+
+void fill() {
+    for (size_t i = 0; i < MAX_STEPS; i++) {
+        uint32_t fq = 100000 + i * 7654321;
+        // a mix of small, large, negative and zero values
+        float r = (i % 9 == 0) ? 0.0f : 0.123456f * i * i;
+        float x = (i % 4 == 0) ? -0.0f : -1500.0f + 23.4567f * i;
+        results.insert(fq, Complex(r, x), 1 + i % 16, i / 64);
+        calibration[i] = CalibrationPoint(fq, Complex(-0.97f + 0.0002f * i, 0.03f), Complex(0.96f, -0.0004f * i), Complex(0.0001f * i, -0.02f));
+    }
+    analyzer.calibration_len_ = MAX_STEPS;
+    analyzer.interpolation_ = CAL_INTERP_CUBIC;
+    analyzer.average_samples_ = 4;
+    analyzer.average_tolerance_ = 0.125f;
+}
+
+template<class F>
+double ns_per_byte(size_t bytes, F fn) {
+    fn();
+    uint32_t calls = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point now;
+    do {
+        fn();
+        calls++;
+        now = std::chrono::steady_clock::now();
+    } while (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() < 100);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count() / ((double)calls * bytes);
+}
+
+int main(int argc, char* argv[]) {
+    fill();
+    AnalyzerPersistence persistence;
+    persistence.begin();
+
+    // files exactly as the sketch writes them
+    persistence.save_results("results.json", &results, &analyzer);
+    persistence.save_settings("settings.json", &analyzer);
+    std::string results_doc = read_file(&persistence.results_dir_, "results.json");
+    std::string settings_doc = read_file(&persistence.settings_dir_, "settings.json");
+    check(results_doc.size() > 0 && settings_doc.size() > 0, "saved files", "empty");
+    check_same_events("results file", results_doc);
+    check_same_events("settings file", settings_doc);
+
+    // and read back through the listeners
+    check(persistence.load_results("results.json", &loaded), "load results", "failed");
+    check(loaded.len_ == results.len_, "load results", "length");
+    for (size_t i = 0; i < loaded.len_; i++) {
+        char buf[24];
+        check(loaded.fq_[i] == results.fq_[i] && loaded.samples(i) == results.samples(i) && loaded.segment(i) == results.segment(i), "loaded result", itoa(i, buf, 10));
+        check(same_bits(loaded.re_[i], atof(dtostrf(results.re_[i], 1, 6, buf))), "loaded result real", itoa(i, buf, 10));
+    }
+    check(persistence.load_settings("settings.json", &loaded_analyzer, MAX_STEPS), "load settings", "failed");
+    check(loaded_analyzer.calibration_len_ == MAX_STEPS && loaded_analyzer.z0_ == 50 && loaded_analyzer.interpolation_ == CAL_INTERP_CUBIC && loaded_analyzer.average_samples_ == 4, "load settings", "fields");
+
+    // loads decode in place: a file that fails before any point is stored
+    // leaves the destination alone, one that fails later empties it
+    {
+        FsFile entry;
+        entry.open(&persistence.results_dir_, "bad.json", O_WRONLY | O_CREAT | O_TRUNC);
+        entry.write("{\"z0\":50}");
+        entry.close();
+        entry.open(&persistence.results_dir_, "cut.json", O_WRONLY | O_CREAT | O_TRUNC);
+        entry.write(results_doc.substr(0, results_doc.size() / 2).c_str());
+        entry.close();
+        entry.open(&persistence.settings_dir_, "cut.json", O_WRONLY | O_CREAT | O_TRUNC);
+        entry.write(settings_doc.substr(0, settings_doc.size() / 2).c_str());
+        entry.close();
+    }
+    check(!persistence.load_results("bad.json", &loaded) && loaded.len_ == results.len_, "load bad results", "destination changed");
+    check(!persistence.load_results("cut.json", &loaded) && loaded.len_ == 0, "load cut results", "partial results kept");
+    loaded_analyzer.z0_ = 75;
+    check(!persistence.load_settings("cut.json", &loaded_analyzer, MAX_STEPS) && loaded_analyzer.calibration_len_ == 0 && loaded_analyzer.z0_ == 75, "load cut settings", "partial settings kept");
+
+    // hand edited files and odd but valid JSON
+    const char* docs[] = {
+        "{\"z0\":50,\"calibration\":[]}",
+        "{ \"z0\" : 50.000000 ,\n  \"calibration\" : [ { \"fq\" : 1000000 , \"cal_short\" : [ -1.0 , 0.0 ] } ]\n}\n",
+        "[{\"fq\":-5,\"uncal_z\":[-0.000000,1e3],\"samples\":+7}]",
+        "[{\"fq\":\"123\",\"uncal_z\":[\"1.5\",true],\"note\":\"a \\\"quoted\\\" \\\\ string\"}]",
+        "[{\"fq\":00042,\"uncal_z\":[.5,-.25],\"segment\":null}]",
+        "[{\"fq\":4294967295,\"uncal_z\":[123456789012345678901234567890,0.0000000000000000000000001]}]",
+        "[{\"fq\":1,\"uncal_z\":[1.2.3,1-2]}] trailing junk",
+        "junk before [1, 2.5,-3]",
+        "{\"a\":{\"b\":{\"c\":[[[]]]}},\"d\":[{},{}]}",
+    };
+    for (size_t i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+        check_same_events("document", docs[i]);
+    }
+
+    // number conversion over a spread of magnitudes and precisions
+    for (int i = 0; i < 20000; i++) {
+        char buf[64];
+        float f = (float)((i * 2654435761u) % 1000003) / (1 << (i % 24)) * ((i & 1) ? -1 : 1);
+        if (i % 3 == 0) {
+            dtostrf(f, 1, 6, buf);
+        } else if (i % 3 == 1) {
+            snprintf(buf, sizeof(buf), "%.9g", f);
+        } else {
+            snprintf(buf, sizeof(buf), "%.17f", (double)f);
+        }
+        JsonValue v;
+        v.clear();
+        for (char* c = buf; *c; c++) {
+            v.push(*c);
+        }
+        check(same_bits(v.to_float(), atof(buf)), "float conversion", buf);
+        check(v.to_long() == atoi(buf), "int conversion", buf);
+    }
+
+    // an overlong number is an error, not a silently cut off value
+    {
+        NullTokenizerListener listener;
+        JsonTokenizer tokenizer;
+        const char* doc = "[12345678901234567890123456789012345678901234567890]";
+        for (const char* c = doc; *c; c++) {
+            tokenizer.parse(*c, &listener);
+        }
+        check(tokenizer.has_error_, "overlong number", doc);
+    }
+
+    double old_ns = ns_per_byte(results_doc.size(), [&]() {
+        NullListener listener;
+        JsonStreamingParser parser;
+        parser.setListener(&listener);
+        for (size_t i = 0; i < results_doc.size(); i++) {
+            parser.parse(results_doc[i]);
+        }
+    });
+    double new_ns = ns_per_byte(results_doc.size(), [&]() {
+        NullTokenizerListener listener;
+        JsonTokenizer tokenizer;
+        for (size_t i = 0; i < results_doc.size(); i++) {
+            tokenizer.parse(results_doc[i], &listener);
+        }
+    });
+    size_t allocs_start = host_allocations;
+    {
+        NullTokenizerListener listener;
+        JsonTokenizer tokenizer;
+        for (size_t i = 0; i < results_doc.size(); i++) {
+            tokenizer.parse(results_doc[i], &listener);
+        }
+    }
+    check(host_allocations == allocs_start, "tokenizer", "allocated");
+    printf("json parse %zu bytes: String parser %.1f ns/byte, tokenizer %.1f ns/byte\n", results_doc.size(), old_ns, new_ns);
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("json tokenizer ok\n");
+    return 0;
+}
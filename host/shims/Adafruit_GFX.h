@@ -0,0 +1,108 @@
+#ifndef _HOST_ADAFRUIT_GFX_H
+#define _HOST_ADAFRUIT_GFX_H
+
+// Counting fake of Adafruit_GFX: nothing is rendered, every primitive is
+// tallied along with an estimate of the pixels it would push over the bus.
+
+#include "Arduino.h"
+
+struct DisplayCounters {
+    uint32_t calls;
+    // 64 bits, fast paths can push more than 4G pixels in one bench run
+    uint64_t pixels;
+    uint32_t lines;
+    uint32_t fills;
+    uint32_t reads;
+    uint32_t chars;
+    uint32_t transactions;
+
+    void reset() { memset(this, 0, sizeof(*this)); }
+};
+
+class Adafruit_GFX : public Print {
+public:
+    Adafruit_GFX(int16_t w, int16_t h) : width_(w), height_(h), raw_width_(w), raw_height_(h), cursor_x_(0), cursor_y_(0), text_size_(1), text_color_(0xFFFF), text_bg_(0xFFFF), rotation_(0) {
+        counters.reset();
+    }
+
+    int16_t width() const { return width_; }
+    int16_t height() const { return height_; }
+    uint8_t getRotation() const { return rotation_; }
+    void setRotation(uint8_t r) {
+        rotation_ = r & 3;
+        if (rotation_ & 1) {
+            width_ = raw_height_;
+            height_ = raw_width_;
+        } else {
+            width_ = raw_width_;
+            height_ = raw_height_;
+        }
+    }
+
+    virtual void startWrite() { counters.transactions++; }
+    virtual void endWrite() {}
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) { counters.calls++; counters.pixels++; }
+    virtual void writePixel(int16_t x, int16_t y, uint16_t color) { counters.pixels++; }
+    virtual uint16_t readPixel(int16_t x, int16_t y) { counters.calls++; counters.reads++; return 0; }
+
+    virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { counters.calls++; counters.lines++; counters.pixels += abs(w); }
+    virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { counters.calls++; counters.lines++; counters.pixels += abs(h); }
+    virtual void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { counters.lines++; counters.pixels += abs(w); }
+    virtual void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { counters.lines++; counters.pixels += abs(h); }
+    virtual void writeLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+        counters.lines++;
+        counters.pixels += max(abs(x1 - x0), abs(y1 - y0)) + 1;
+    }
+    virtual void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+        counters.calls++;
+        startWrite();
+        writeLine(x0, y0, x1, y1, color);
+        endWrite();
+    }
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) { counters.calls++; counters.fills++; counters.pixels += (uint32_t)abs(w) * abs(h); }
+    virtual void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) { counters.fills++; counters.pixels += (uint32_t)abs(w) * abs(h); }
+    virtual void fillScreen(uint16_t color) { fillRect(0, 0, width_, height_, color); }
+    void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) { counters.calls++; counters.pixels += 2 * (abs(w) + abs(h)); }
+    void drawCircle(int16_t x, int16_t y, int16_t r, uint16_t color) { counters.calls++; counters.pixels += 7 * abs(r); }
+    void fillCircle(int16_t x, int16_t y, int16_t r, uint16_t color) { counters.calls++; counters.pixels += 4 * r * r; }
+    void drawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) { counters.calls++; counters.pixels += abs(x1 - x0) + abs(y1 - y0) + abs(x2 - x1) + abs(y2 - y1) + abs(x0 - x2) + abs(y0 - y2); }
+    void drawRGBBitmap(int16_t x, int16_t y, const uint16_t* bitmap, int16_t w, int16_t h) { counters.calls++; counters.pixels += (uint32_t)w * h; }
+    void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size) {
+        counters.calls++;
+        counters.chars++;
+        counters.pixels += (color == bg ? 8 : 6 * 8) * size * size;
+    }
+
+    void setCursor(int16_t x, int16_t y) { cursor_x_ = x; cursor_y_ = y; }
+    int16_t getCursorX() const { return cursor_x_; }
+    int16_t getCursorY() const { return cursor_y_; }
+    void setTextSize(uint8_t s) { text_size_ = s; }
+    void setTextColor(uint16_t c) { text_color_ = c; text_bg_ = c; }
+    void setTextColor(uint16_t c, uint16_t bg) { text_color_ = c; text_bg_ = bg; }
+    void setTextWrap(bool w) {}
+
+    using Print::write;
+    size_t write(uint8_t c) {
+        if (c == '\n') {
+            cursor_x_ = 0;
+            cursor_y_ += 8 * text_size_;
+        } else if (c != '\r') {
+            drawChar(cursor_x_, cursor_y_, c, text_color_, text_bg_, text_size_);
+            cursor_x_ += 6 * text_size_;
+        }
+        return 1;
+    }
+
+    DisplayCounters counters;
+
+protected:
+    int16_t width_, height_;
+    int16_t raw_width_, raw_height_;
+    int16_t cursor_x_, cursor_y_;
+    uint8_t text_size_;
+    uint16_t text_color_, text_bg_;
+    uint8_t rotation_;
+};
+
+#endif //_HOST_ADAFRUIT_GFX_H
@@ -0,0 +1,15 @@
+#ifndef _HOST_ADAFRUIT_TFTLCD_H
+#define _HOST_ADAFRUIT_TFTLCD_H
+
+#include "Adafruit_GFX.h"
+
+// HX8357 panel: 320x480 native, the analyzer runs it rotated
+class Adafruit_TFTLCD : public Adafruit_GFX {
+public:
+    Adafruit_TFTLCD(uint8_t cs, uint8_t cd, uint8_t wr, uint8_t rd, uint8_t rst) : Adafruit_GFX(320, 480) {}
+    void begin(uint16_t id) {}
+    uint16_t readID() { return 0x8357; }
+    void reset() {}
+};
+
+#endif //_HOST_ADAFRUIT_TFTLCD_H
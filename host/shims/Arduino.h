@@ -0,0 +1,194 @@
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+// Minimal host-side stand-in for the Arduino core, enough to compile the
+// analyzer headers on Linux for benchmarking and tests.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+template<class T, class L>
+auto min(const T& a, const L& b) -> decltype((b < a) ? b : a) { return (b < a) ? b : a; }
+template<class T, class L>
+auto max(const T& a, const L& b) -> decltype((b < a) ? b : a) { return (a < b) ? b : a; }
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// host build counts every allocation made through the String shim (and
+// operator new) so benchmarks can report allocations per operation
+extern size_t host_allocations;
+
+char* itoa(int value, char* str, int base);
+char* utoa(unsigned value, char* str, int base);
+char* dtostrf(double val, signed char width, unsigned char prec, char* buf);
+
+class String {
+public:
+    String() : buf_(NULL), len_(0) {}
+    String(const char* s) : buf_(NULL), len_(0) { assign(s, s ? strlen(s) : 0); }
+    String(const __FlashStringHelper* s) : String(reinterpret_cast<const char*>(s)) {}
+    String(const String& s) : buf_(NULL), len_(0) { assign(s.buf_, s.len_); }
+    String(char c) : buf_(NULL), len_(0) { assign(&c, 1); }
+    String(int v, unsigned char base=10) : buf_(NULL), len_(0) { char b[34]; itoa(v, b, base); assign(b, strlen(b)); }
+    String(unsigned int v, unsigned char base=10) : buf_(NULL), len_(0) { char b[34]; utoa(v, b, base); assign(b, strlen(b)); }
+    String(long v, unsigned char base=10) : String((int)v, base) {}
+    String(unsigned long v, unsigned char base=10) : String((unsigned int)v, base) {}
+    String(float v, unsigned char prec=2) : buf_(NULL), len_(0) { char b[48]; dtostrf(v, 1, prec, b); assign(b, strlen(b)); }
+    String(double v, unsigned char prec=2) : buf_(NULL), len_(0) { char b[48]; dtostrf(v, 1, prec, b); assign(b, strlen(b)); }
+    ~String() { delete [] buf_; }
+
+    String& operator=(const String& s) { if (this != &s) { assign(s.buf_, s.len_); } return *this; }
+    String& operator=(const char* s) { assign(s, s ? strlen(s) : 0); return *this; }
+
+    String& operator+=(const String& s) { append(s.buf_, s.len_); return *this; }
+    String& operator+=(const char* s) { append(s, strlen(s)); return *this; }
+    String& operator+=(char c) { append(&c, 1); return *this; }
+
+    bool operator==(const String& s) const { return len_ == s.len_ && (len_ == 0 || memcmp(buf_, s.buf_, len_) == 0); }
+    bool operator==(const char* s) const { return strcmp(c_str(), s) == 0; }
+    bool operator!=(const String& s) const { return !(*this == s); }
+    bool operator!=(const char* s) const { return !(*this == s); }
+
+    const char* c_str() const { return buf_ ? buf_ : ""; }
+    unsigned int length() const { return len_; }
+    char operator[](unsigned int i) const { return i < len_ ? buf_[i] : 0; }
+
+    void toCharArray(char* buf, unsigned int bufsize) const {
+        if (bufsize == 0) {
+            return;
+        }
+        unsigned int n = len_ < bufsize - 1 ? len_ : bufsize - 1;
+        memcpy(buf, c_str(), n);
+        buf[n] = 0;
+    }
+    long toInt() const { return atol(c_str()); }
+    float toFloat() const { return atof(c_str()); }
+
+private:
+    void assign(const char* s, size_t n) {
+        delete [] buf_;
+        buf_ = NULL;
+        len_ = 0;
+        append(s, n);
+    }
+    void append(const char* s, size_t n) {
+        if (n == 0) {
+            return;
+        }
+        char* next = new char[len_ + n + 1];
+        if (buf_) {
+            memcpy(next, buf_, len_);
+        }
+        memcpy(next + len_, s, n);
+        next[len_ + n] = 0;
+        delete [] buf_;
+        buf_ = next;
+        len_ += n;
+    }
+
+    char* buf_;
+    size_t len_;
+};
+
+template<class T>
+String operator+(const String& lhs, const T& rhs) { String s(lhs); s += String(rhs); return s; }
+inline String operator+(const String& lhs, const char* rhs) { String s(lhs); s += rhs; return s; }
+inline String operator+(const String& lhs, const String& rhs) { String s(lhs); s += rhs; return s; }
+inline String operator+(const char* lhs, const String& rhs) { String s(lhs); s += rhs; return s; }
+
+class Print;
+
+class Printable {
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t n) {
+        size_t written = 0;
+        for (size_t i = 0; i < n; i++) {
+            written += write(buf[i]);
+        }
+        return written;
+    }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const __FlashStringHelper* s) { return write(reinterpret_cast<const char*>(s)); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v, int base=DEC) { char b[34]; itoa(v, b, base); return write(b); }
+    size_t print(unsigned int v, int base=DEC) { char b[34]; utoa(v, b, base); return write(b); }
+    size_t print(long v, int base=DEC) { return print((int)v, base); }
+    size_t print(unsigned long v, int base=DEC) { return print((unsigned int)v, base); }
+    size_t print(long long v, int base=DEC) { char b[34]; snprintf(b, sizeof(b), "%lld", v); return write(b); }
+    size_t print(unsigned long long v, int base=DEC) { char b[34]; snprintf(b, sizeof(b), "%llu", v); return write(b); }
+    size_t print(double v, int prec=2) { char b[48]; dtostrf(v, 1, prec, b); return write(b); }
+    size_t print(const Printable& p) { return p.printTo(*this); }
+
+    size_t println() { return write("\r\n"); }
+    template<class T>
+    size_t println(const T& v) { size_t n = print(v); return n + println(); }
+    template<class T>
+    size_t println(const T& v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+};
+
+// Serial sink: discards output but counts bytes, set echo to see output
+class HostSerial : public Print {
+public:
+    HostSerial() : bytes_written(0), echo(false) {}
+    void begin(unsigned long) {}
+    void flush() {}
+    int read() { return -1; }
+    int available() { return 0; }
+    operator bool() const { return true; }
+    using Print::write;
+    size_t write(uint8_t c) {
+        bytes_written++;
+        if (echo) {
+            putchar(c);
+        }
+        return 1;
+    }
+    size_t bytes_written;
+    bool echo;
+};
+
+extern HostSerial Serial;
+
+#endif //_HOST_ARDUINO_H
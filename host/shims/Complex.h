@@ -0,0 +1,65 @@
+#ifndef _HOST_COMPLEX_H
+#define _HOST_COMPLEX_H
+
+// Host stand-in for the Arduino Complex library (same public API and the
+// same single precision arithmetic)
+
+#include "Arduino.h"
+
+class Complex : public Printable {
+public:
+    Complex(const float r = 0, const float i = 0) : re(r), im(i) {}
+    Complex(const Complex &c) : re(c.re), im(c.im) {}
+    Complex& operator=(const Complex &c) { re = c.re; im = c.im; return *this; }
+
+    void set(const float r, const float i) { re = r; im = i; }
+    void setReal(const float r) { re = r; }
+    void setImag(const float i) { im = i; }
+    float real() const { return re; }
+    float imag() const { return im; }
+
+    size_t printTo(Print& p) const {
+        size_t n = p.print(re, 3);
+        n += p.print(' ');
+        n += p.print(im, 3);
+        n += p.print('i');
+        return n;
+    }
+
+    float phase() const { return atan2f(im, re); }
+    float modulus() const { return hypotf(re, im); }
+    Complex conjugate() const { return Complex(re, -im); }
+    Complex reciprocal() const {
+        float f = 1.0f / (re * re + im * im);
+        return Complex(re * f, -im * f);
+    }
+
+    bool operator==(const Complex &c) const { return (re == c.re) && (im == c.im); }
+    bool operator!=(const Complex &c) const { return !(*this == c); }
+
+    Complex operator-() const { return Complex(-re, -im); }
+    Complex operator+(const Complex &c) const { return Complex(re + c.re, im + c.im); }
+    Complex operator-(const Complex &c) const { return Complex(re - c.re, im - c.im); }
+    Complex operator*(const Complex &c) const {
+        return Complex(re * c.re - im * c.im, re * c.im + im * c.re);
+    }
+    Complex operator/(const Complex &c) const {
+        float f = 1.0f / (c.re * c.re + c.im * c.im);
+        float r = (re * c.re + im * c.im) * f;
+        float i = (im * c.re - re * c.im) * f;
+        return Complex(r, i);
+    }
+
+    Complex& operator+=(const Complex &c) { re += c.re; im += c.im; return *this; }
+    Complex& operator-=(const Complex &c) { re -= c.re; im -= c.im; return *this; }
+    Complex& operator*=(const Complex &c) { *this = *this * c; return *this; }
+    Complex& operator/=(const Complex &c) { *this = *this / c; return *this; }
+
+protected:
+    float re;
+    float im;
+};
+
+static Complex const one(1, 0);
+
+#endif //_HOST_COMPLEX_H
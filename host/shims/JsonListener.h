@@ -0,0 +1,20 @@
+#ifndef _HOST_JSON_LISTENER_H
+#define _HOST_JSON_LISTENER_H
+
+#include "Arduino.h"
+
+class JsonListener {
+public:
+    virtual ~JsonListener() {}
+    virtual void whitespace(char c) = 0;
+    virtual void startDocument() = 0;
+    virtual void key(String key) = 0;
+    virtual void value(String value) = 0;
+    virtual void endArray() = 0;
+    virtual void endObject() = 0;
+    virtual void endDocument() = 0;
+    virtual void startArray() = 0;
+    virtual void startObject() = 0;
+};
+
+#endif //_HOST_JSON_LISTENER_H
@@ -0,0 +1,138 @@
+#ifndef _HOST_JSON_STREAMING_PARSER_H
+#define _HOST_JSON_STREAMING_PARSER_H
+
+// Host stand-in for squix78's JsonStreamingParser. Like the original it
+// hands every key and value to the listener as a heap allocated String.
+// The sketch parses with JsonTokenizer now, host/json_test.cpp keeps this
+// as the reference it has to agree with.
+
+#include "JsonListener.h"
+
+class JsonStreamingParser {
+public:
+    JsonStreamingParser() : listener_(NULL) { reset(); }
+
+    void setListener(JsonListener* listener) { listener_ = listener; }
+
+    void reset() {
+        state_ = START_DOCUMENT;
+        depth_ = 0;
+        buffer_len_ = 0;
+    }
+
+    void parse(char c) {
+        switch (state_) {
+            case START_DOCUMENT:
+                if (c == '[' || c == '{') {
+                    listener_->startDocument();
+                    structural(c);
+                }
+                break;
+            case IN_STRING:
+                if (c == '"' && !escape_) {
+                    buffer_[buffer_len_] = 0;
+                    if (string_is_key_) {
+                        listener_->key(String(buffer_));
+                        state_ = AFTER_KEY;
+                    } else {
+                        listener_->value(String(buffer_));
+                        state_ = AFTER_VALUE;
+                    }
+                    buffer_len_ = 0;
+                } else if (c == '\\' && !escape_) {
+                    escape_ = true;
+                } else {
+                    escape_ = false;
+                    push(c);
+                }
+                break;
+            case IN_LITERAL:
+                if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= 'a' && c <= 'z')) {
+                    push(c);
+                    break;
+                }
+                buffer_[buffer_len_] = 0;
+                listener_->value(String(buffer_));
+                buffer_len_ = 0;
+                state_ = AFTER_VALUE;
+                // fall through to handle the terminating character
+            default:
+                structural(c);
+        }
+    }
+
+private:
+    enum { START_DOCUMENT, IN_CONTAINER, AFTER_KEY, AFTER_VALUE, IN_STRING, IN_LITERAL, DONE };
+
+    void push(char c) {
+        if (buffer_len_ < sizeof(buffer_) - 1) {
+            buffer_[buffer_len_++] = c;
+        }
+    }
+
+    void structural(char c) {
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            listener_->whitespace(c);
+            return;
+        }
+        switch (c) {
+            case '{':
+                stack_[depth_++] = '{';
+                listener_->startObject();
+                state_ = IN_CONTAINER;
+                break;
+            case '[':
+                stack_[depth_++] = '[';
+                listener_->startArray();
+                state_ = IN_CONTAINER;
+                break;
+            case '}':
+            case ']':
+                if (depth_ == 0) {
+                    return;
+                }
+                depth_--;
+                if (c == '}') {
+                    listener_->endObject();
+                } else {
+                    listener_->endArray();
+                }
+                state_ = AFTER_VALUE;
+                if (depth_ == 0) {
+                    listener_->endDocument();
+                    state_ = DONE;
+                }
+                break;
+            case ',':
+                state_ = IN_CONTAINER;
+                break;
+            case ':':
+                state_ = IN_CONTAINER;
+                break;
+            case '"':
+                string_is_key_ = depth_ > 0 && stack_[depth_ - 1] == '{' && state_ == IN_CONTAINER && !after_colon_;
+                escape_ = false;
+                state_ = IN_STRING;
+                break;
+            default:
+                if (state_ == DONE) {
+                    return;
+                }
+                push(c);
+                state_ = IN_LITERAL;
+        }
+        after_colon_ = (c == ':');
+    }
+
+    JsonListener* listener_;
+    int state_;
+    char stack_[32];
+    size_t depth_;
+    char buffer_[64];
+    size_t buffer_len_;
+    bool string_is_key_;
+    bool escape_;
+    bool after_colon_;
+};
+
+#endif //_HOST_JSON_STREAMING_PARSER_H
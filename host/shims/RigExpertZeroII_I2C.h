@@ -0,0 +1,39 @@
+#ifndef _HOST_RIGEXPERT_ZEROII_I2C_H
+#define _HOST_RIGEXPERT_ZEROII_I2C_H
+
+// Host stand-in for the Zero II: reports a fixed series RLC load so sweeps
+// produce a resonance with a plausible SWR dip.
+
+#include "Arduino.h"
+
+class RigExpertZeroII_I2C {
+public:
+    RigExpertZeroII_I2C() : r_(50), x_(0), measurements_(0) {}
+
+    bool startZeroII() { return true; }
+    bool startMeasure(uint32_t fq) {
+        measurements_++;
+        // 28.5MHz series resonance
+        float w = 2 * M_PI * (float)fq;
+        float l = 1e-6;
+        float c = 1.0 / (l * (2 * M_PI * 28.5e6) * (2 * M_PI * 28.5e6));
+        r_ = 42;
+        x_ = w * l - 1.0 / (w * c);
+        return true;
+    }
+    float getR() { return r_; }
+    float getX() { return x_; }
+
+    uint8_t getMajorVersion() { return 1; }
+    uint8_t getMinorVersion() { return 0; }
+    uint8_t getHwRevision() { return 1; }
+    uint32_t getSerialNumber() { return 0; }
+
+    uint32_t measurements_;
+
+private:
+    float r_;
+    float x_;
+};
+
+#endif //_HOST_RIGEXPERT_ZEROII_I2C_H
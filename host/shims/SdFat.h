@@ -0,0 +1,205 @@
+#ifndef _HOST_SDFAT_H
+#define _HOST_SDFAT_H
+
+// Host stand-in for SdFat backed by an in-memory filesystem. Only the
+// subset of FsFile used by the analyzer is provided.
+
+#include <fcntl.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+#ifndef O_AT_END
+#define O_AT_END O_APPEND
+#endif
+
+#define FS_DATE(y, m, d) ((uint16_t)((((y) - 1980) << 9) | ((m) << 5) | (d)))
+#define FS_TIME(h, m, s) ((uint16_t)(((h) << 11) | ((m) << 5) | ((s) >> 1)))
+
+#define FAT_TYPE_EXFAT 64
+#define FAT_TYPE_FAT32 32
+#define FAT_TYPE_FAT16 16
+
+struct HostNode {
+    bool is_dir;
+    std::vector<uint8_t> data;
+    uint32_t block_reads;
+    uint32_t block_writes;
+};
+
+// every path ("/a/b") maps to a node; directories are listed by prefix
+typedef std::map<std::string, HostNode> HostFs;
+extern HostFs host_fs;
+// count calls into the file layer so benchmarks can see per-call overhead
+extern size_t host_fs_calls;
+
+class FsFile : public Print {
+public:
+    FsFile() : open_(false), pos_(0), dir_pos_(0), error_(0) {}
+
+    bool open(const char* path, int oflag = O_RDONLY) {
+        return open_path(normalize(path), oflag);
+    }
+    bool open(FsFile* dir, const char* name, int oflag = O_RDONLY) {
+        return open_path(join(dir->path_, name), oflag);
+    }
+    bool mkdir(FsFile* parent, const char* name, bool parents = true) {
+        std::string p = join(parent->path_, name);
+        if (host_fs.count(p)) {
+            return false;
+        }
+        host_fs[p].is_dir = true;
+        return open_path(p, O_RDONLY);
+    }
+    bool close() {
+        open_ = false;
+        return true;
+    }
+    bool isOpen() const { return open_; }
+    bool isDirectory() const { return open_ && node()->is_dir; }
+    bool isDir() const { return isDirectory(); }
+    bool sync() { return true; }
+
+    int read() {
+        host_fs_calls++;
+        HostNode* n = node();
+        if (!open_ || pos_ >= n->data.size()) {
+            return -1;
+        }
+        return n->data[pos_++];
+    }
+    int read(void* buf, size_t count) {
+        host_fs_calls++;
+        HostNode* n = node();
+        if (!open_) {
+            return -1;
+        }
+        size_t avail = n->data.size() - pos_;
+        if (count > avail) {
+            count = avail;
+        }
+        memcpy(buf, n->data.data() + pos_, count);
+        pos_ += count;
+        n->block_reads++;
+        return count;
+    }
+    int available() {
+        if (!open_) {
+            return 0;
+        }
+        return node()->data.size() - pos_;
+    }
+    uint64_t size() { return open_ ? node()->data.size() : 0; }
+    uint64_t curPosition() const { return pos_; }
+    bool seekSet(uint64_t pos) {
+        if (!open_ || pos > node()->data.size()) {
+            return false;
+        }
+        pos_ = pos;
+        return true;
+    }
+    uint8_t getError() const { return error_; }
+
+    using Print::write;
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t n) {
+        host_fs_calls++;
+        if (!open_) {
+            return 0;
+        }
+        HostNode* node_ = node();
+        if (pos_ + n > node_->data.size()) {
+            node_->data.resize(pos_ + n);
+        }
+        memcpy(node_->data.data() + pos_, buf, n);
+        pos_ += n;
+        node_->block_writes++;
+        return n;
+    }
+    size_t write(const void* buf, size_t n) { return write((const uint8_t*)buf, n); }
+
+    size_t getName(char* name, size_t size) {
+        std::string base = path_.substr(path_.rfind('/') + 1);
+        if (size == 0) {
+            return 0;
+        }
+        size_t n = base.size() < size - 1 ? base.size() : size - 1;
+        memcpy(name, base.c_str(), n);
+        name[n] = 0;
+        return n;
+    }
+
+    bool getModifyDateTime(uint16_t* date, uint16_t* time) {
+        *date = FS_DATE(2024, 1, 1);
+        *time = FS_TIME(0, 0, 0);
+        return true;
+    }
+
+    void rewindDirectory() { dir_pos_ = 0; }
+
+    bool openNext(FsFile* dir, int oflag = O_RDONLY) {
+        std::string prefix = dir->path_ == "/" ? "/" : dir->path_ + "/";
+        size_t idx = 0;
+        for (HostFs::iterator it = host_fs.lower_bound(prefix); it != host_fs.end(); ++it) {
+            const std::string& p = it->first;
+            if (p.compare(0, prefix.size(), prefix) != 0) {
+                break;
+            }
+            if (p.size() == prefix.size() || p.find('/', prefix.size()) != std::string::npos) {
+                continue;
+            }
+            if (idx++ == dir->dir_pos_) {
+                dir->dir_pos_++;
+                return open_path(p, oflag);
+            }
+        }
+        return false;
+    }
+
+    std::string path_;
+
+private:
+    HostNode* node() const { return &host_fs[path_]; }
+
+    static std::string normalize(const char* path) {
+        std::string p(path);
+        if (p.empty() || p[0] != '/') {
+            p = "/" + p;
+        }
+        if (p.size() > 1 && p[p.size() - 1] == '/') {
+            p.erase(p.size() - 1);
+        }
+        return p;
+    }
+    static std::string join(const std::string& dir, const char* name) {
+        return dir == "/" ? "/" + std::string(name) : dir + "/" + name;
+    }
+
+    bool open_path(const std::string& p, int oflag) {
+        HostFs::iterator it = host_fs.find(p);
+        if (it == host_fs.end()) {
+            if (!(oflag & O_CREAT)) {
+                return false;
+            }
+            host_fs[p].is_dir = false;
+        } else if ((oflag & O_TRUNC) && !it->second.is_dir) {
+            it->second.data.clear();
+        }
+        path_ = p;
+        open_ = true;
+        pos_ = (oflag & O_APPEND) ? node()->data.size() : 0;
+        dir_pos_ = 0;
+        return true;
+    }
+
+    bool open_;
+    size_t pos_;
+    size_t dir_pos_;
+    uint8_t error_;
+};
+
+typedef FsFile FsBaseFile;
+
+#endif //_HOST_SDFAT_H
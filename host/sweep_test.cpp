@@ -0,0 +1,104 @@
+// Checks the block calibration kernel against the scalar Complex path.
+// Built twice by `make test`, once with the SIMD kernel and once with
+// SWEEP_NO_SIMD, and both must match the scalar results bit for bit.
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "Complex.h"
+#include "RigExpertZeroII_I2C.h"
+
+#include "analyzer.h"
+#include "frequency_plan.h"
+#include "sweep_buffer.h"
+
+#define MAX_STEPS 64
+
+int failures = 0;
+
+void check(bool ok, const char* what, size_t i) {
+    if (!ok) {
+        printf("FAIL %s at %zu\n", what, i);
+        failures++;
+    }
+}
+
+bool same_bits(float a, float b) {
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+uint32_t fqs[MAX_STEPS];
+float res[MAX_STEPS];
+float ims[MAX_STEPS];
+SweepBuffer sweep(fqs, res, ims, MAX_STEPS);
+
+CalibrationPoint calibration[MAX_STEPS];
+Analyzer analyzer(50, calibration);
+
+uint32_t plan_fqs[MAX_STEPS];
+uint16_t plan_calibration_idx[MAX_STEPS];
+FrequencyPlan plan(plan_fqs, plan_calibration_idx, MAX_STEPS);
+
+float gamma_re[MAX_STEPS];
+float gamma_im[MAX_STEPS];
+
+// compare calibrate_sweep with calibrated_gamma point by point
+void check_sweep(const char* name, const FrequencyPlan* sweep_plan) {
+    calibrate_sweep(&analyzer, sweep, sweep_plan, gamma_re, gamma_im);
+    for (size_t i = 0; i < sweep.len_; i++) {
+        Complex expected = analyzer.calibrated_gamma(sweep[i]);
+        check(same_bits(gamma_re[i], expected.real()) && same_bits(gamma_im[i], expected.imag()), name, i);
+    }
+}
+
+void fill_sweep(size_t len, uint32_t offset) {
+    plan.initialize_log(1000000, 60000000, len);
+    for (size_t i = 0; i < plan.len(); i++) {
+        // a mix of ordinary, reactive and extreme loads
+        float r = (i % 7 == 0) ? 0.0f : 5.0f + 37.0f * (i % 11);
+        float x = (i % 5 == 0) ? -0.0f : -300.0f + 61.0f * (i % 13);
+        sweep.set(i, plan.fq(i) + offset, Complex(r, x));
+    }
+    sweep.len_ = plan.len();
+}
+
+void fill_calibration(size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        float t = (float)i / len;
+        calibration[i] = CalibrationPoint(plan.fq(i), Complex(-0.97 + 0.02 * t, 0.03 * t), Complex(0.96 - 0.05 * t, -0.04 * t), Complex(0.02 * t, 0.01 - 0.02 * t));
+    }
+    analyzer.calibration_len_ = len;
+    analyzer.calibration_changed();
+}
+
+int main(int argc, char* argv[]) {
+    // no calibration at all
+    fill_sweep(MAX_STEPS, 0);
+    analyzer.calibration_len_ = 0;
+    analyzer.calibration_changed();
+    check_sweep("uncalibrated", NULL);
+
+    // results on the calibration grid, with and without plan indices
+    fill_calibration(MAX_STEPS);
+    plan.relate(&analyzer);
+    check_sweep("on grid with plan", &plan);
+    check_sweep("on grid without plan", NULL);
+
+    // off grid, both interpolation modes, including a partial last block
+    for (uint8_t interp = CAL_INTERP_LINEAR; interp <= CAL_INTERP_CUBIC; interp++) {
+        analyzer.interpolation_ = interp;
+        fill_sweep(MAX_STEPS - 3, 1234);
+        check_sweep(interp == CAL_INTERP_LINEAR ? "off grid linear" : "off grid cubic", &plan);
+    }
+
+    // a single point
+    fill_sweep(1, 0);
+    check_sweep("single point", NULL);
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("sweep kernel ok\n");
+    return 0;
+}
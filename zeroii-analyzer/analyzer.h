@@ -41,6 +41,13 @@ Complex calibrate_reflection(Complex sc, Complex oc, Complex load, Complex refle
     return cal_gamma;
 }
 
+// same correction as above, but with the error terms already solved
+// e00 is the directivity term which is just the load measurement
+Complex correct_reflection(Complex e00, Complex e11, Complex e01e10, Complex reflection) {
+    Complex d = reflection - e00;
+    return d/(e01e10 + e11*d);
+}
+
 float compute_swr(Complex gamma) {
     float mag = gamma.modulus();
     if (mag > 1) {
@@ -50,6 +57,16 @@ float compute_swr(Complex gamma) {
     }
 }
 
+float compute_return_loss(Complex gamma) {
+    // return loss in dB, positive for a passive load
+    float mag = gamma.modulus();
+    if (mag <= 0) {
+        return INFINITY;
+    } else {
+        return -20 * log10(mag);
+    }
+}
+
 struct AnalysisPoint {
     uint32_t fq;
     Complex uncal_z;
@@ -58,19 +75,27 @@ struct AnalysisPoint {
     AnalysisPoint(const AnalysisPoint &p): fq(p.fq), uncal_z(p.uncal_z) {}
     AnalysisPoint(uint32_t a_fq, Complex a_uncal_z) : fq(a_fq), uncal_z(a_uncal_z) {}
 
-    static const size_t data_size = sizeof(uint32_t)+sizeof(Complex);
+    static const size_t data_size = sizeof(uint32_t)+2*sizeof(float);
 
+    // data doesn't have to be aligned (e.g. records packed in a file
+    // buffer), so copy rather than cast
     static AnalysisPoint from_bytes(const uint8_t* data) {
         // assume data has enough elements
-        uint32_t fq = *(uint32_t*)data;
-        Complex c = *(Complex*)(data+sizeof(uint32_t));
+        uint32_t fq;
+        float re, im;
+        memcpy(&fq, data, sizeof(fq));
+        memcpy(&re, data+sizeof(uint32_t), sizeof(re));
+        memcpy(&im, data+sizeof(uint32_t)+sizeof(float), sizeof(im));
 
-        return AnalysisPoint(fq, c);
+        return AnalysisPoint(fq, Complex(re, im));
     }
 
     static void to_bytes(AnalysisPoint point, uint8_t* data) {
-        *(uint32_t*)data = point.fq;
-        *(Complex *)(data+sizeof(uint32_t)) = point.uncal_z;
+        float re = point.uncal_z.real();
+        float im = point.uncal_z.imag();
+        memcpy(data, &point.fq, sizeof(point.fq));
+        memcpy(data+sizeof(uint32_t), &re, sizeof(re));
+        memcpy(data+sizeof(uint32_t)+sizeof(float), &im, sizeof(im));
     }
 };
 
@@ -78,67 +103,259 @@ struct CalibrationPoint {
     CalibrationPoint() {
     }
 
-    CalibrationPoint(const CalibrationPoint &p) {
-        fq = p.fq;
-        cal_short = p.cal_short;
-        cal_open = p.cal_open;
-        cal_load = p.cal_load;
-    }
-
     CalibrationPoint(uint32_t f, Complex s, Complex o, Complex l) {
         fq = f;
         cal_short = s;
         cal_open = o;
         cal_load = l;
+        solve();
+    }
+
+    // solve the SOL error terms from the measured standards
+    // this needs to happen whenever the standards change (calibration
+    // finishes or is loaded) so calibrated_gamma only does one divide
+    void solve() {
+        Complex two = Complex(2);
+        Complex d = cal_open - cal_short;
+        e00 = cal_load;
+        e11 = (cal_short + cal_open - two*cal_load)/d;
+        e01e10 = two * (cal_open - cal_load)*(cal_load - cal_short)/d;
+    }
+
+    Complex calibrate(Complex uncal_gamma) const {
+        return correct_reflection(e00, e11, e01e10, uncal_gamma);
     }
 
     uint32_t fq;
     Complex cal_short;
     Complex cal_open;
     Complex cal_load;
+
+    // error terms derived from the standards above
+    Complex e00;
+    Complex e11;
+    Complex e01e10;
 };
 
 bool CalibrationCmp(const CalibrationPoint &lhs, const uint32_t &fq) {
     return lhs.fq < fq;
 }
 
+// interpolate error terms between calibration points a and b
+// only the error terms of out are set
+void interpolate_linear(const CalibrationPoint &a, const CalibrationPoint &b, uint32_t fq, CalibrationPoint* out) {
+    Complex t((float)(fq - a.fq) / (float)(b.fq - a.fq));
+    out->fq = fq;
+    out->e00 = a.e00 + (b.e00 - a.e00)*t;
+    out->e11 = a.e11 + (b.e11 - a.e11)*t;
+    out->e01e10 = a.e01e10 + (b.e01e10 - a.e01e10)*t;
+}
+
+// cubic lagrange interpolation through four calibration points
+// frequencies don't have to be evenly spaced (e.g. log sweeps)
+// only the error terms of out are set
+void interpolate_cubic(const CalibrationPoint* p, uint32_t fq, CalibrationPoint* out) {
+    // work relative to p[1] to keep float precision at high frequencies
+    float x[4];
+    for(size_t k=0; k<4; k++) {
+        x[k] = (float)((int32_t)(p[k].fq - p[1].fq));
+    }
+    float xf = (float)((int32_t)(fq - p[1].fq));
+
+    out->fq = fq;
+    out->e00 = Complex(0);
+    out->e11 = Complex(0);
+    out->e01e10 = Complex(0);
+    for(size_t k=0; k<4; k++) {
+        float w = 1;
+        for(size_t j=0; j<4; j++) {
+            if(j != k) {
+                w *= (xf - x[j]) / (x[k] - x[j]);
+            }
+        }
+        Complex cw(w);
+        out->e00 += p[k].e00*cw;
+        out->e11 += p[k].e11*cw;
+        out->e01e10 += p[k].e01e10*cw;
+    }
+}
+
+enum CAL_INTERPOLATION { CAL_INTERP_LINEAR, CAL_INTERP_CUBIC };
+
 CalibrationPoint uncalibrated_point = CalibrationPoint(0, Complex(-1), Complex(1), Complex(0));
 
+// most readings averaged for a single point
+#define AVERAGE_MAX_SAMPLES 16
+// default tolerance on the standard error of the mean, relative to |Z|
+#define AVERAGE_DEFAULT_TOLERANCE 0.005
+// smallest |Z| the tolerance is relative to, so a short doesn't demand an
+// impossibly small error
+#define AVERAGE_MIN_SCALE 1.0
+
+// running mean and variance of repeated readings of R and X at one
+// frequency, using Welford's method so no readings are kept around
+class MeasurementAverage {
+    public:
+        MeasurementAverage() {
+            reset();
+        }
+
+        void reset() {
+            samples_ = 0;
+            mean_r_ = 0;
+            mean_x_ = 0;
+            m2_r_ = 0;
+            m2_x_ = 0;
+        }
+
+        void add(Complex z) {
+            samples_++;
+            float dr = z.real() - mean_r_;
+            float dx = z.imag() - mean_x_;
+            mean_r_ += dr / samples_;
+            mean_x_ += dx / samples_;
+            m2_r_ += dr * (z.real() - mean_r_);
+            m2_x_ += dx * (z.imag() - mean_x_);
+        }
+
+        Complex mean() const {
+            return Complex(mean_r_, mean_x_);
+        }
+
+        // true once the standard error of the mean of both R and X is
+        // within tolerance of |Z|. needs at least two readings.
+        bool stable(float tolerance) const {
+            if(samples_ < 2) {
+                return false;
+            }
+            float scale = tolerance * max(mean().modulus(), (float)AVERAGE_MIN_SCALE);
+            // var/n = m2/((n-1)*n), compared squared to skip the sqrt
+            float limit = scale * scale * (samples_ - 1) * samples_;
+            return m2_r_ <= limit && m2_x_ <= limit;
+        }
+
+        uint8_t samples_;
+
+    private:
+        float mean_r_;
+        float mean_x_;
+        float m2_r_;
+        float m2_x_;
+};
+
+// remembers where the last calibration lookup landed so callers walking a
+// sweep in ascending fq order don't search from scratch for every point
+struct CalibrationCursor {
+    CalibrationCursor() : idx(0), fq(0) {}
+
+    size_t idx;
+    uint32_t fq;
+};
+
 class Analyzer {
     public:
         Analyzer(float z0, CalibrationPoint* calibration_results) {
             z0_ = z0;
             calibration_len_ = 0;
             calibration_results_ = calibration_results;
+            interpolation_ = CAL_INTERP_LINEAR;
+            generation_ = 0;
+            average_samples_ = 1;
+            average_tolerance_ = AVERAGE_DEFAULT_TOLERANCE;
+        }
+
+        // call after z0 or calibration changes so derived results rebuild
+        void calibration_changed() {
+            generation_++;
         }
 
+        // the Zero II driver only returns once it has a result, so this
+        // blocks for the whole measurement
         Complex uncalibrated_measure(uint32_t fq) {
             zeroii_.startMeasure(fq);
 
             float R = zeroii_.getR();
             float X = zeroii_.getX();
 
-            analysis_logger.debug(String("")+R+" + "+X+" i");
+            if(analysis_logger.enabled(LOG_DEBUG)) {
+                analysis_logger.debug(String("")+R+" + "+X+" i");
+            }
 
             return Complex(R, X);
         }
 
+        // true once avg has enough readings for one point: the most we
+        // average, or fewer if the readings have settled down
+        bool average_done(const MeasurementAverage &avg) const {
+            return avg.samples_ >= average_samples_ || avg.stable(average_tolerance_);
+        }
+
+        // measure fq repeatedly per the averaging settings, optionally
+        // returning how many readings went into the result
+        Complex averaged_measure(uint32_t fq, uint8_t* samples=NULL) {
+            MeasurementAverage avg;
+            do {
+                avg.add(uncalibrated_measure(fq));
+            } while(!average_done(avg));
+            if(samples) {
+                *samples = avg.samples_;
+            }
+            return avg.mean();
+        }
+
         Complex calibrated_gamma(const AnalysisPoint &p) const {
             return calibrated_gamma(p.fq, p.uncal_z);
         }
 
+        // when the caller already knows which calibration point was
+        // measured at p.fq (see FrequencyPlan) we can skip the search
+        Complex calibrated_gamma(const AnalysisPoint &p, uint16_t cal_idx) const {
+            if(cal_idx < calibration_len_ && calibration_results_[cal_idx].fq == p.fq) {
+                return calibration_results_[cal_idx].calibrate(compute_gamma(p.uncal_z, z0_));
+            }
+            return calibrated_gamma(p.fq, p.uncal_z);
+        }
+
         Complex calibrated_gamma(uint32_t fq, Complex uncalibrated_z) const {
-            CalibrationPoint* cal = find_calibration(fq);
-            return calibrate_reflection(cal->cal_short, cal->cal_open, cal->cal_load, compute_gamma(uncalibrated_z, z0_));
+            CalibrationPoint scratch;
+            return calibration_at(fq, &scratch)->calibrate(compute_gamma(uncalibrated_z, z0_));
         }
 
-        CalibrationPoint* find_calibration(uint32_t fq) const {
-            if(calibration_len_ == 0) {
-                return &uncalibrated_point;
+        // same as above but walks the calibration with cursor instead of
+        // searching, cheap when points come in ascending fq order
+        Complex calibrated_gamma(const AnalysisPoint &p, CalibrationCursor* cursor) const {
+            CalibrationPoint scratch;
+            return calibration_at(p.fq, cursor, &scratch)->calibrate(compute_gamma(p.uncal_z, z0_));
+        }
+
+        // solve error terms for every calibration point
+        void solve_calibration() {
+            for(size_t i=0; i<calibration_len_; i++) {
+                calibration_results_[i].solve();
+            }
+        }
+
+        // error terms at fq, interpolated between neighboring calibration
+        // points when fq isn't one of them. outside the calibrated range we
+        // use the nearest calibration point.
+        // returns either a calibration point or scratch filled in with
+        // interpolated error terms, which saves copying exact matches
+        const CalibrationPoint* calibration_at(uint32_t fq, CalibrationPoint* scratch) const {
+            size_t i = std::lower_bound(calibration_results_, &calibration_results_[calibration_len_], fq, CalibrationCmp) - calibration_results_;
+            return calibration_near(i, fq, scratch);
+        }
+
+        const CalibrationPoint* calibration_at(uint32_t fq, CalibrationCursor* cursor, CalibrationPoint* scratch) const {
+            if(fq < cursor->fq || cursor->idx > calibration_len_) {
+                // went backwards (or the calibration shrank), start over
+                cursor->idx = std::lower_bound(calibration_results_, &calibration_results_[calibration_len_], fq, CalibrationCmp) - calibration_results_;
             } else {
-                size_t i;
-                return std::lower_bound(calibration_results_, &calibration_results_[calibration_len_], fq, CalibrationCmp);
+                while(cursor->idx < calibration_len_ && calibration_results_[cursor->idx].fq < fq) {
+                    cursor->idx++;
+                }
             }
+            cursor->fq = fq;
+            return calibration_near(cursor->idx, fq, scratch);
         }
 
         RigExpertZeroII_I2C zeroii_;
@@ -146,6 +363,34 @@ class Analyzer {
         float z0_;
         size_t calibration_len_;
         CalibrationPoint *calibration_results_;
+        uint8_t interpolation_;
+        uint32_t generation_;
+
+        // most readings to average per point, 1 turns averaging off
+        uint8_t average_samples_;
+        // stop averaging early once the standard error is within this
+        // fraction of |Z|
+        float average_tolerance_;
+
+    private:
+        // i is the first calibration point at or above fq
+        const CalibrationPoint* calibration_near(size_t i, uint32_t fq, CalibrationPoint* scratch) const {
+            if(calibration_len_ == 0) {
+                return &uncalibrated_point;
+            }
+            if(i == calibration_len_) {
+                return &calibration_results_[calibration_len_-1];
+            } else if(i == 0 || calibration_results_[i].fq == fq) {
+                return &calibration_results_[i];
+            } else if(interpolation_ == CAL_INTERP_CUBIC && calibration_len_ >= 4) {
+                // pick four points around fq, shifting the window at the ends
+                size_t start = constrain((int32_t)i-2, 0, (int32_t)calibration_len_-4);
+                interpolate_cubic(&calibration_results_[start], fq, scratch);
+            } else {
+                interpolate_linear(calibration_results_[i-1], calibration_results_[i], fq, scratch);
+            }
+            return scratch;
+        }
 };
 
 #endif
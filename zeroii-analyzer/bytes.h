@@ -0,0 +1,63 @@
+#ifndef _BYTES_H
+#define _BYTES_H
+
+#include <Complex.h>
+
+// Packing numbers into byte buffers for files. Buffers don't have to be
+// aligned, and numbers are stored in the processor's (little endian) order.
+
+const uint32_t crc32_nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+// standard (zlib) CRC-32 a nibble at a time, start from 0xFFFFFFFF and
+// invert the result
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len) {
+    for(size_t i=0; i<len; i++) {
+        crc = crc32_nibble_table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = crc32_nibble_table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return crc;
+}
+
+void put_u16(uint8_t* data, uint16_t v) {
+    memcpy(data, &v, sizeof(v));
+}
+
+void put_u32(uint8_t* data, uint32_t v) {
+    memcpy(data, &v, sizeof(v));
+}
+
+void put_f32(uint8_t* data, float v) {
+    memcpy(data, &v, sizeof(v));
+}
+
+uint16_t get_u16(const uint8_t* data) {
+    uint16_t v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+}
+
+uint32_t get_u32(const uint8_t* data) {
+    uint32_t v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+}
+
+float get_f32(const uint8_t* data) {
+    float v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+}
+
+void put_complex(uint8_t* data, Complex c) {
+    put_f32(data, c.real());
+    put_f32(data+sizeof(float), c.imag());
+}
+
+Complex get_complex(const uint8_t* data) {
+    return Complex(get_f32(data), get_f32(data+sizeof(float)));
+}
+
+#endif //_BYTES_H
@@ -0,0 +1,184 @@
+#ifndef _FILE_STREAM_H
+#define _FILE_STREAM_H
+
+#include <SdFat.h>
+
+#include "log.h"
+
+Logger file_stream_logger("file_stream");
+
+// one SD sector
+#define FILE_STREAM_BUFFER_SIZE 512
+
+// Every FileReader and FileWriter shares this buffer, so only one can be
+// open at a time. That's always the case as long as streams don't outlive
+// the call (or scheduler step) that opened them. If one is opened while
+// the buffer is taken it goes straight to the file, slow but still correct.
+uint8_t file_stream_buffer[FILE_STREAM_BUFFER_SIZE];
+bool file_stream_buffer_taken = false;
+
+uint8_t* take_file_stream_buffer() {
+    if(file_stream_buffer_taken) {
+        file_stream_logger.warn(F("file stream buffer already taken, unbuffered"));
+        return NULL;
+    }
+    file_stream_buffer_taken = true;
+    return file_stream_buffer;
+}
+
+void release_file_stream_buffer(uint8_t* buffer) {
+    if(buffer == file_stream_buffer) {
+        file_stream_buffer_taken = false;
+    }
+}
+
+// Reads a file a sector at a time from the current position
+class FileReader {
+    public:
+        FileReader(FsFile* file) {
+            file_ = file;
+            buffer_ = take_file_stream_buffer();
+            pos_ = 0;
+            len_ = 0;
+            failed_ = false;
+        }
+
+        ~FileReader() {
+            release_file_stream_buffer(buffer_);
+        }
+
+        // next byte or -1 at the end of the file (or on an error)
+        int read() {
+            if(pos_ == len_ && !fill()) {
+                return -1;
+            }
+            return buffer_ ? buffer_[pos_++] : file_->read();
+        }
+
+        // returns how many bytes were read, less than len at the end of the
+        // file
+        size_t read(void* data, size_t len) {
+            uint8_t* out = (uint8_t*)data;
+            size_t done = 0;
+            while(done < len) {
+                if(pos_ == len_ && !fill()) {
+                    break;
+                }
+                if(!buffer_) {
+                    int n = file_->read(out+done, len-done);
+                    if(n <= 0) {
+                        failed_ = n < 0;
+                        break;
+                    }
+                    done += n;
+                    continue;
+                }
+                size_t n = min(len-done, len_-pos_);
+                memcpy(out+done, buffer_+pos_, n);
+                pos_ += n;
+                done += n;
+            }
+            return done;
+        }
+
+        // drops anything buffered
+        bool seek(uint32_t pos) {
+            pos_ = 0;
+            len_ = 0;
+            return file_->seekSet(pos);
+        }
+
+        // true if reading stopped on an error rather than the end of the file
+        bool failed() const {
+            return failed_;
+        }
+
+    private:
+        bool fill() {
+            if(!buffer_) {
+                // unbuffered, let the caller go to the file
+                return file_->available() > 0;
+            }
+            int n = file_->read(buffer_, FILE_STREAM_BUFFER_SIZE);
+            if(n <= 0) {
+                failed_ = n < 0;
+                return false;
+            }
+            pos_ = 0;
+            len_ = n;
+            return true;
+        }
+
+        FsFile* file_;
+        uint8_t* buffer_;
+        size_t pos_;
+        size_t len_;
+        bool failed_;
+};
+
+// Collects writes and passes them to the file a sector at a time. Anything
+// left is written by flush() or when the writer goes away. Errors stick, so
+// a whole file can be written and checked once with ok().
+class FileWriter {
+    public:
+        FileWriter(FsFile* file) {
+            file_ = file;
+            buffer_ = take_file_stream_buffer();
+            len_ = 0;
+            ok_ = true;
+        }
+
+        ~FileWriter() {
+            flush();
+            release_file_stream_buffer(buffer_);
+        }
+
+        size_t write(uint8_t c) {
+            return write(&c, 1);
+        }
+
+        size_t write(const char* s) {
+            return write(s, strlen(s));
+        }
+
+        size_t write(const void* data, size_t len) {
+            if(!buffer_) {
+                size_t n = file_->write((const uint8_t*)data, len);
+                ok_ = ok_ && n == len;
+                return n;
+            }
+            const uint8_t* in = (const uint8_t*)data;
+            size_t left = len;
+            while(left > 0) {
+                size_t n = min(left, FILE_STREAM_BUFFER_SIZE - len_);
+                memcpy(buffer_+len_, in, n);
+                len_ += n;
+                in += n;
+                left -= n;
+                if(len_ == FILE_STREAM_BUFFER_SIZE && !flush()) {
+                    break;
+                }
+            }
+            return len - left;
+        }
+
+        bool flush() {
+            if(len_ > 0) {
+                ok_ = ok_ && file_->write(buffer_, len_) == len_;
+                len_ = 0;
+            }
+            return ok_;
+        }
+
+        bool ok() const {
+            return ok_;
+        }
+
+    private:
+        FsFile* file_;
+        uint8_t* buffer_;
+        size_t len_;
+        bool ok_;
+};
+
+#endif //_FILE_STREAM_H
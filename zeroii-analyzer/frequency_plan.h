@@ -0,0 +1,269 @@
+#ifndef _FREQUENCY_PLAN_H
+#define _FREQUENCY_PLAN_H
+
+#include "log.h"
+#include "analyzer.h"
+
+Logger plan_logger("plan");
+
+enum PLAN_SPACING { PLAN_LOG, PLAN_LINEAR, PLAN_LIST };
+// how a plan lines up with the current calibration
+enum PLAN_RELATION { PLAN_UNRELATED, PLAN_SUBSET, PLAN_IDENTICAL };
+
+#define NO_CALIBRATION_INDEX 0xFFFF
+
+#define MAX_PLAN_SEGMENTS 8
+
+// one range of a multi segment plan
+struct PlanSegment {
+    uint32_t start_fq;
+    uint32_t end_fq;
+    size_t steps;
+};
+
+// A precomputed table of sweep frequencies shared by the analysis and
+// calibration processes so both measure exactly the same frequencies.
+// A plan can be split into several segments (e.g. a few bands) which are
+// swept together, see initialize_segments.
+class FrequencyPlan {
+    public:
+        FrequencyPlan(uint32_t* fqs, uint16_t* calibration_idx, size_t max_len) {
+            fqs_ = fqs;
+            calibration_idx_ = calibration_idx;
+            max_len_ = max_len;
+            len_ = 0;
+            spacing_ = PLAN_LOG;
+            segments_ = 1;
+            segment_end_[0] = 0;
+            clear_relation();
+        }
+
+        // steps frequencies evenly spaced on a log scale from start to end
+        bool initialize_log(uint32_t start_fq, uint32_t end_fq, size_t steps) {
+            if(!check_range(start_fq, end_fq, steps)) {
+                return false;
+            }
+            spacing_ = PLAN_LOG;
+            fill_log(fqs_, start_fq, end_fq, len_);
+            finish(start_fq, end_fq);
+            return true;
+        }
+
+        // steps frequencies evenly spaced from start to end
+        bool initialize_linear(uint32_t start_fq, uint32_t end_fq, size_t steps) {
+            if(!check_range(start_fq, end_fq, steps)) {
+                return false;
+            }
+            spacing_ = PLAN_LINEAR;
+            fill_linear(fqs_, start_fq, end_fq, len_);
+            finish(start_fq, end_fq);
+            return true;
+        }
+
+        // several ranges, each with its own number of steps, swept one
+        // after the other. segments must be ascending and not overlap so
+        // the plan as a whole stays sorted.
+        bool initialize_segments(const PlanSegment* segments, size_t count, uint8_t spacing) {
+            size_t total = 0;
+            for(size_t s=0; s<count; s++) {
+                const PlanSegment &seg = segments[s];
+                if(seg.steps == 0 || seg.end_fq < seg.start_fq || (seg.steps > 1 && seg.end_fq == seg.start_fq) || (s > 0 && seg.start_fq <= segments[s-1].end_fq)) {
+                    plan_logger.error(String("bad plan segment ")+s+" startFq "+seg.start_fq+" endFq "+seg.end_fq+" steps "+seg.steps);
+                    count = 0;
+                    break;
+                }
+                total += seg.steps;
+            }
+            if(count == 0 || count > MAX_PLAN_SEGMENTS || total > max_len_) {
+                plan_logger.error(String("bad plan with ")+count+" segments and "+total+" steps");
+                len_ = 0;
+                clear_relation();
+                return false;
+            }
+
+            spacing_ = spacing;
+            size_t offset = 0;
+            for(size_t s=0; s<count; s++) {
+                if(spacing == PLAN_LINEAR) {
+                    fill_linear(&fqs_[offset], segments[s].start_fq, segments[s].end_fq, segments[s].steps);
+                } else {
+                    fill_log(&fqs_[offset], segments[s].start_fq, segments[s].end_fq, segments[s].steps);
+                }
+                offset += segments[s].steps;
+            }
+            len_ = total;
+            finish(segments[0].start_fq, segments[count-1].end_fq);
+            segments_ = count;
+            offset = 0;
+            for(size_t s=0; s<count; s++) {
+                offset += segments[s].steps;
+                segment_end_[s] = offset;
+            }
+            plan_logger.info(String("plan has ")+segments_+" segments");
+            return true;
+        }
+
+        // an explicit list of frequencies which must be ascending
+        bool initialize_list(const uint32_t* fqs, size_t len) {
+            if(len == 0 || len > max_len_) {
+                len_ = 0;
+                return false;
+            }
+            for(size_t i=1; i<len; i++) {
+                if(fqs[i] < fqs[i-1]) {
+                    plan_logger.error(String("frequency list not ascending at ")+i);
+                    len_ = 0;
+                    return false;
+                }
+            }
+            spacing_ = PLAN_LIST;
+            len_ = len;
+            memcpy(fqs_, fqs, sizeof(uint32_t)*len);
+            finish(fqs[0], fqs[len-1]);
+            return true;
+        }
+
+        // map every plan frequency onto the analyzer's calibration points
+        // this is a single merge pass and only happens when the plan or the
+        // calibration changes
+        void relate(const Analyzer* analyzer) {
+            if(related_ && analyzer_generation_ == analyzer->generation_) {
+                return;
+            }
+            const CalibrationPoint* cal = analyzer->calibration_results_;
+            size_t cal_len = analyzer->calibration_len_;
+            size_t matched = 0;
+            size_t j = 0;
+            for(size_t i=0; i<len_; i++) {
+                while(j < cal_len && cal[j].fq < fqs_[i]) {
+                    j++;
+                }
+                if(j < cal_len && cal[j].fq == fqs_[i]) {
+                    calibration_idx_[i] = j;
+                    matched++;
+                } else {
+                    calibration_idx_[i] = NO_CALIBRATION_INDEX;
+                }
+            }
+
+            if(len_ > 0 && matched == len_) {
+                relation_ = matched == cal_len ? PLAN_IDENTICAL : PLAN_SUBSET;
+            } else {
+                relation_ = PLAN_UNRELATED;
+            }
+            related_ = true;
+            analyzer_generation_ = analyzer->generation_;
+            plan_logger.info(String("plan relation to calibration ")+relation_+" matched "+matched+"/"+len_);
+        }
+
+        // index of the calibration point measured at fq(i), or
+        // NO_CALIBRATION_INDEX if there isn't one (or we haven't related)
+        uint16_t calibration_index(size_t i) const {
+            if(!related_ || i >= len_) {
+                return NO_CALIBRATION_INDEX;
+            }
+            return calibration_idx_[i];
+        }
+
+        uint32_t fq(size_t i) const {
+            return fqs_[i];
+        }
+
+        size_t len() const {
+            return len_;
+        }
+
+        size_t segments() const {
+            return segments_;
+        }
+
+        // index one past the last point of segment s
+        size_t segment_end(size_t s) const {
+            return segment_end_[s];
+        }
+
+        // segment point i belongs to
+        uint8_t segment_of(size_t i) const {
+            size_t s = 0;
+            while(s+1 < segments_ && i >= segment_end_[s]) {
+                s++;
+            }
+            return s;
+        }
+
+        uint8_t spacing_;
+        uint8_t relation_;
+        uint32_t start_fq_;
+        uint32_t end_fq_;
+
+    private:
+        uint32_t* fqs_;
+        uint16_t* calibration_idx_;
+        size_t max_len_;
+        size_t len_;
+        size_t segments_;
+        size_t segment_end_[MAX_PLAN_SEGMENTS];
+
+        bool related_;
+        uint32_t analyzer_generation_;
+
+        bool check_range(uint32_t start_fq, uint32_t end_fq, size_t steps) {
+            if(steps == 0 || steps > max_len_ || end_fq < start_fq || (steps > 1 && end_fq == start_fq)) {
+                plan_logger.error(String("bad plan startFq ")+start_fq+" endFq "+end_fq+" steps "+steps);
+                len_ = 0;
+                clear_relation();
+                return false;
+            }
+            len_ = steps;
+            return true;
+        }
+
+        // each step is computed directly from the index in single
+        // precision so there's no accumulated error and no double math
+        static void fill_log(uint32_t* fqs, uint32_t start_fq, uint32_t end_fq, size_t len) {
+            if(len > 1) {
+                float log_step = logf((float)end_fq/(float)start_fq)/(float)(len-1);
+                for(size_t i=0; i<len; i++) {
+                    fqs[i] = constrain((uint32_t)(start_fq * expf(log_step * i) + 0.5f), start_fq, end_fq);
+                }
+            }
+            pin_ends(fqs, start_fq, end_fq, len);
+        }
+
+        static void fill_linear(uint32_t* fqs, uint32_t start_fq, uint32_t end_fq, size_t len) {
+            if(len > 1) {
+                uint32_t range = end_fq - start_fq;
+                for(size_t i=0; i<len; i++) {
+                    fqs[i] = start_fq + (uint32_t)((uint64_t)range * i / (len-1));
+                }
+            }
+            pin_ends(fqs, start_fq, end_fq, len);
+        }
+
+        static void pin_ends(uint32_t* fqs, uint32_t start_fq, uint32_t end_fq, size_t len) {
+            if(len == 1) {
+                // a single point is just the start
+                fqs[0] = start_fq;
+            } else {
+                // pin the ends exactly regardless of rounding
+                fqs[0] = start_fq;
+                fqs[len-1] = end_fq;
+            }
+        }
+
+        void finish(uint32_t start_fq, uint32_t end_fq) {
+            segments_ = 1;
+            segment_end_[0] = len_;
+            start_fq_ = start_fq;
+            end_fq_ = end_fq;
+            clear_relation();
+            plan_logger.info(String("plan spacing ")+spacing_+" startFq "+start_fq+" endFq "+end_fq+" steps "+len_);
+        }
+
+        void clear_relation() {
+            related_ = false;
+            relation_ = PLAN_UNRELATED;
+        }
+};
+
+#endif //_FREQUENCY_PLAN_H
@@ -2,9 +2,15 @@
 #define _GRAPH_H
 
 #include "log.h"
+#include "text_field.h"
 
 Logger graph_logger = Logger("graph");
 
+// at most 5 characters up to an SWR of 1000
+String swr_formatter(const float swr) {
+    return String(swr, swr < 100 ? 2 : 1);
+}
+
 String frequency_formatter(const int32_t fq) {
     int int_part, dec_part;
     char buf[3+1+3+3+1];
@@ -31,38 +37,176 @@ String frequency_formatter(const int32_t fq) {
     }
 }
 
-void read_patch(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t* patch) {
-    for (int16_t j = 0; j < h; j++, y++) {
-        for (int16_t i = 0; i < w; i++) {
-            patch[j * w + i] = tft.readPixel(x+i, y);
+#define POINTER_WIDTH 8
+#define POINTER_HEIGHT 8
+
+// screen coordinates for points that can't be drawn (NaN or infinite), the
+// trace breaks around them
+#define TRACE_BREAK INT16_MIN
+// points far off the plot are pulled in to this so they fit in an int16_t
+// and clipping math can't overflow
+#define TRACE_COORD_LIMIT 8192
+
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_TOP 4
+#define CLIP_BOTTOM 8
+
+// Cohen-Sutherland line clipping against an inclusive rectangle
+struct ClipRect {
+    int16_t x0;
+    int16_t y0;
+    int16_t x1;
+    int16_t y1;
+
+    uint8_t outcode(int32_t x, int32_t y) const {
+        uint8_t code = 0;
+        if (x < x0) {
+            code |= CLIP_LEFT;
+        } else if (x > x1) {
+            code |= CLIP_RIGHT;
+        }
+        if (y < y0) {
+            code |= CLIP_TOP;
+        } else if (y > y1) {
+            code |= CLIP_BOTTOM;
         }
+        return code;
     }
-}
 
-#define POINTER_WIDTH 8
-#define POINTER_HEIGHT 8
+    bool contains(int16_t x, int16_t y) const {
+        return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+    }
+
+    bool overlaps(const ClipRect &r) const {
+        return r.x0 <= x1 && r.x1 >= x0 && r.y0 <= y1 && r.y1 >= y0;
+    }
+
+    // grow to cover r as well
+    void cover(const ClipRect &r) {
+        x0 = min(x0, r.x0);
+        y0 = min(y0, r.y0);
+        x1 = max(x1, r.x1);
+        y1 = max(y1, r.y1);
+    }
+
+    // clips the line to the rectangle in place, returns false if none of
+    // it is inside
+    bool clip(int16_t* ax, int16_t* ay, int16_t* bx, int16_t* by) const {
+        int32_t xa = *ax, ya = *ay, xb = *bx, yb = *by;
+        uint8_t code_a = outcode(xa, ya);
+        uint8_t code_b = outcode(xb, yb);
+        // each pass puts an end on an edge, integer rounding can take a few
+        for (uint8_t pass = 0; pass < 8; pass++) {
+            if (!(code_a | code_b)) {
+                *ax = xa;
+                *ay = ya;
+                *bx = xb;
+                *by = yb;
+                return true;
+            }
+            if (code_a & code_b) {
+                return false;
+            }
+            uint8_t code = code_a ? code_a : code_b;
+            int32_t x, y;
+            if (code & CLIP_TOP) {
+                x = xa + (xb - xa) * (y0 - ya) / (yb - ya);
+                y = y0;
+            } else if (code & CLIP_BOTTOM) {
+                x = xa + (xb - xa) * (y1 - ya) / (yb - ya);
+                y = y1;
+            } else if (code & CLIP_LEFT) {
+                y = ya + (yb - ya) * (x0 - xa) / (xb - xa);
+                x = x0;
+            } else {
+                y = ya + (yb - ya) * (x1 - xa) / (xb - xa);
+                x = x1;
+            }
+            if (code == code_a) {
+                xa = x;
+                ya = y;
+                code_a = outcode(xa, ya);
+            } else {
+                xb = x;
+                yb = y;
+                code_b = outcode(xb, yb);
+            }
+        }
+        return false;
+    }
+};
+
+enum GRAPH_MODE { GRAPH_SWR, GRAPH_SMITH };
+
+// Everything drawn under the trace (axes, guides, labels) is recorded as a
+// short list of these, so the part of the graph under the pointer can be
+// drawn again from the list instead of read back from the panel.
+enum LAYER_KIND { LAYER_HLINE, LAYER_VLINE, LAYER_CIRCLE, LAYER_DOT, LAYER_LABEL };
+
+// the SWR graph has the most: a dot and label at the start of each segment,
+// the end and the two guides, plus the four borders, the two guide lines
+// and a separator between each pair of segments
+#define MAX_LAYER_LABELS (MAX_PLAN_SEGMENTS+3)
+#define MAX_LAYER_ITEMS (4 + 2 + (MAX_PLAN_SEGMENTS-1) + 2*MAX_LAYER_LABELS)
+#define LAYER_LABEL_LEN 12
+
+struct LayerItem {
+    uint8_t kind;
+    uint16_t color;
+    int16_t x;
+    int16_t y;
+    // length for lines, radius for circles and dots, label index for labels
+    int16_t size;
+};
 
 class GraphContext {
 public:
-    GraphContext(const AnalysisPoint* results, const size_t results_len, const Analyzer* analyzer) : swr_i_(0), results_(results), results_len_(results_len), analyzer_(analyzer) {}
+    GraphContext(const DerivedResults& results, const Analyzer* analyzer) : pointer_x_(-1), pointer_y_(-1), swr_i_(0), results_(results), analyzer_(analyzer), traced_len_(0), trace_valid_(false), damage_(NULL), layers_len_(0), labels_len_(0), min_swr_valid_(false) {
+        // the first title line leaves room for the battery on the right
+        uint8_t title_width = (tft.width()-8*TITLE_TEXT_SIZE*5)/(6*TITLE_TEXT_SIZE);
+        uint8_t coords_width = tft.width()/(6*TITLE_TEXT_SIZE);
+        title_min_.initialize(0, 0, TITLE_TEXT_SIZE, title_width);
+        title_sel_.initialize(0, 8*TITLE_TEXT_SIZE, TITLE_TEXT_SIZE, coords_width);
+        coords_min_.initialize(0, tft.height()-2*8*TITLE_TEXT_SIZE, TITLE_TEXT_SIZE, coords_width);
+        coords_sel_.initialize(0, tft.height()-8*TITLE_TEXT_SIZE, TITLE_TEXT_SIZE, coords_width);
+    }
 
+    // results from a multi segment plan get one panel per segment side by
+    // side, so the gaps between bands don't take up any room
     void initialize_swr() {
-        uint32_t start_fq;
-        uint32_t end_fq;
-        if(results_len_ == 0) {
-            start_fq = MIN_FQ;
-            end_fq = MAX_FQ;
-        } else if (results_len_ == 1) {
-            start_fq = results_[0].fq-100;
-            end_fq = results_[0].fq+100;
+        if(results_.len_ == 0) {
+            initialize_swr(MIN_FQ, MAX_FQ);
+        } else if (results_.len_ == 1) {
+            initialize_swr(results_.fq(0)-100, results_.fq(0)+100);
         } else {
-            start_fq = results_[0].fq;
-            end_fq = results_[results_len_-1].fq;
+            initialize_swr(results_.fq(0), results_.fq(results_.len_-1));
+            segments_ = 0;
+            for (size_t i=0; i<results_.len_; i++) {
+                if (i == 0 || results_.segment(i) != results_.segment(i-1)) {
+                    if (segments_ == MAX_PLAN_SEGMENTS) {
+                        break;
+                    }
+                    segment_fq_[segments_][0] = results_.fq(i);
+                    segments_++;
+                }
+                segment_fq_[segments_-1][1] = results_.fq(i);
+            }
+            x_max_ = segments_;
+            set_mapping();
         }
-        // x ranges from start fq to end fq
+    }
+
+    // fixed frequency range, e.g. for a live sweep that hasn't got results yet
+    void initialize_swr(uint32_t start_fq, uint32_t end_fq) {
+        mode_ = GRAPH_SWR;
+        // x ranges across the segment panels, see fq_to_x
         // y ranges from 1 to 5
-        x_min_ = start_fq;
-        x_max_ = end_fq;
+        segments_ = 1;
+        segment_fq_[0][0] = start_fq;
+        segment_fq_[0][1] = end_fq;
+        x_min_ = 0;
+        x_max_ = 1;
         y_min_ = 5;
         y_max_ = 1;
 
@@ -70,9 +214,11 @@ public:
         y_screen_ = 8*TITLE_TEXT_SIZE*2;
         width_ = tft.width()-x_screen_-5*6*LABEL_TEXT_SIZE;
         height_ = tft.height()-y_screen_-8*2;
+        set_mapping();
     }
 
     void initialize_smith(bool zoom) {
+        mode_ = GRAPH_SMITH;
         // gamma range, x is real, y is imag
         x_min_ = -1;
         x_max_ = 1;
@@ -92,145 +238,127 @@ public:
             height_ = tft.height()-y_screen_-1;
             width_ = height_;
         }
+        set_mapping();
     }
 
     template<class T>
     void draw_swr_label(const T label, uint32_t fq, float swr, const Analyzer* analyzer) {
         int16_t label_xy[2];
 
-        translate_to_screen(fq, swr, label_xy);
-        tft.fillCircle(label_xy[0], label_xy[1], 2, WHITE);
-        tft.setCursor(label_xy[0]-6*LABEL_TEXT_SIZE/2-4*6*LABEL_TEXT_SIZE, label_xy[1]+8*LABEL_TEXT_SIZE/2);
-        tft.print(label);
+        translate_to_screen(fq_to_x(fq), swr, label_xy);
+        layer_dot(label_xy[0], label_xy[1], 2, WHITE);
+        layer_label(label_xy[0]-6*LABEL_TEXT_SIZE/2-4*6*LABEL_TEXT_SIZE, label_xy[1]+8*LABEL_TEXT_SIZE/2, String(label), GRAY);
     }
 
     void graph_swr() {
-        graph_logger.info(String("graphing swr plot with ")+results_len_+" points");
+        graph_logger.info(String("graphing swr plot with ")+results_.len_+" points");
 
-        // set the pointer patch outside the graph area
-        pointer_patch_x = tft.width();
-        pointer_patch_y = tft.height();
+        // no pointer until it's drawn over the new graph
+        pointer_x_ = -1;
 
         // area is just below the title
         tft.fillRect(0, 5*2*8, tft.width(), 3*8*3, BLACK);
         tft.fillRect(0, 8*TITLE_TEXT_SIZE, tft.width(), tft.height()-8*TITLE_TEXT_SIZE, BLACK);
+        invalidate_text();
 
-        // draw axes
-        tft.drawFastHLine(x_screen_, y_screen_, width_, WHITE);
-        tft.drawFastHLine(x_screen_, y_screen_+height_, width_, WHITE);
-        tft.drawFastVLine(x_screen_, y_screen_, height_, WHITE);
-        tft.drawFastVLine(x_screen_+width_, y_screen_, height_, WHITE);
+        draw_swr_axes();
 
-        uint32_t start_fq = results_[0].fq;
-        uint32_t end_fq = results_[results_len_-1].fq;
+        // draw all the analysis points
+        if (results_.len_ == 0) {
+            graph_logger.info(F("no results to plot"));
+            traced_len_ = 0;
+            return;
+        }
+
+        //TODO: what do we do if none of the SWR falls into plottable region?
+
+        draw_trace();
+    }
+
+    void draw_swr_axes() {
+        clear_layers();
+        layer_hline(x_screen_, y_screen_, width_, WHITE);
+        layer_hline(x_screen_, y_screen_+height_, width_, WHITE);
+        layer_vline(x_screen_, y_screen_, height_, WHITE);
+        layer_vline(x_screen_+width_, y_screen_, height_, WHITE);
+
+        uint32_t start_fq = segment_fq_[0][0];
+        uint32_t end_fq = segment_fq_[segments_-1][1];
 
         // add some axes labels fq min/max, swr 1.5, 3
-        tft.setTextSize(LABEL_TEXT_SIZE);
-        tft.setTextColor(GRAY);
-        draw_swr_label(frequency_formatter(start_fq), start_fq, 1.0, analyzer_);
+        // with several segments each panel gets its start labelled
+        for (size_t s=0; s<segments_; s++) {
+            draw_swr_label(frequency_formatter(segment_fq_[s][0]), segment_fq_[s][0], 1.0, analyzer_);
+        }
         draw_swr_label(frequency_formatter(end_fq), end_fq, 1.0, analyzer_);
         draw_swr_label(1.5, start_fq, 1.5, analyzer_);
         draw_swr_label(3.0, start_fq, 3.0, analyzer_);
-        tft.setTextColor(WHITE);
 
         int16_t xy_cutoff[2];
         translate_to_screen(0, 3, xy_cutoff);
-        tft.drawFastHLine(x_screen_, xy_cutoff[1], width_, RED);
+        layer_hline(x_screen_, xy_cutoff[1], width_, RED);
         translate_to_screen(0, 1.5, xy_cutoff);
-        tft.drawFastHLine(x_screen_, xy_cutoff[1], width_, MAGENTA);
-        // draw all the analysis points
-        if (results_len_ == 0) {
-            graph_logger.info(F("no results to plot"));
-            return;
-        }
-
-        //TODO: what do we do if none of the SWR falls into plottable region?
+        layer_hline(x_screen_, xy_cutoff[1], width_, MAGENTA);
 
-        if (results_len_ == 1) {
-            int16_t xy[2];
-            translate_to_screen(results_[0].fq, compute_swr(analyzer_->calibrated_gamma(results_[0])), xy);
-            tft.fillCircle(xy[0], xy[1], 3, YELLOW);
-        } else {
-            for (size_t i=0; i<results_len_-1; i++) {
-                float swr = compute_swr(analyzer_->calibrated_gamma(results_[i]));
-                int16_t xy_start[2];
-                translate_to_screen(results_[i].fq, swr, xy_start);
-                int16_t xy_end[2];
-                translate_to_screen(results_[i+1].fq, compute_swr(analyzer_->calibrated_gamma(results_[i+1])), xy_end);
-                graph_logger.debug(String("drawing line ")+xy_start[0]+","+xy_start[1]+" to "+xy_end[0]+","+xy_end[1]);
-                tft.drawLine(xy_start[0], xy_start[1], xy_end[0], xy_end[1], YELLOW);
-            }
+        for (size_t s=1; s<segments_; s++) {
+            translate_to_screen(s, 1, xy_cutoff);
+            layer_vline(xy_cutoff[0], y_screen_, height_, GRAY);
         }
     }
 
     void draw_swr_pointer() {
-        if (results_len_ == 0) {
+        if (results_.len_ == 0) {
             return;
         }
-        uint32_t start_fq = results_[0].fq;
-        uint32_t end_fq = results_[results_len_-1].fq;
-
-        //first clear the old swr pointer
-        if(pointer_patch_x < tft.width() && pointer_patch_y < tft.height()) {
-            tft.drawRGBBitmap(pointer_patch_x, pointer_patch_y, pointer_patch, POINTER_WIDTH, POINTER_HEIGHT);
-        }
-
-        //draw the "pointer"
         int16_t xy_pointer[2];
-        translate_to_screen(results_[swr_i_].fq, compute_swr(analyzer_->calibrated_gamma(results_[swr_i_])), xy_pointer);
-        pointer_patch_x = xy_pointer[0]-POINTER_WIDTH/2;
-        pointer_patch_y = xy_pointer[1];
-        read_patch(pointer_patch_x, pointer_patch_y, POINTER_WIDTH, POINTER_HEIGHT, pointer_patch);
-        tft.drawTriangle(xy_pointer[0], xy_pointer[1], xy_pointer[0]-POINTER_WIDTH/2, xy_pointer[1]+POINTER_HEIGHT-1, xy_pointer[0]+POINTER_WIDTH/2-1, xy_pointer[1]+POINTER_HEIGHT-1, GREEN);
+        point_xy(swr_i_, xy_pointer);
+        draw_pointer(xy_pointer);
     }
 
-    size_t draw_swr_title() {
-        if (results_len_ == 0) {
-            tft.fillRect(0, 0, tft.width()-8*TITLE_TEXT_SIZE*5, 8*TITLE_TEXT_SIZE, BLACK);
-            tft.setCursor(0,0);
-            tft.setTextSize(TITLE_TEXT_SIZE);
-            tft.println("No SWR results");
-            return 0;
+    // index of the lowest SWR point, only rescanned when results change
+    size_t min_swr_i() {
+        if (min_swr_valid_ && min_swr_generation_ == results_.generation_) {
+            return min_swr_i_;
         }
-
-        size_t min_swr_i = 0;
-        float min_swr = compute_swr(analyzer_->calibrated_gamma(results_[0]));
-        for (size_t i=0; i<results_len_; i++) {
-            float swr = compute_swr(analyzer_->calibrated_gamma(results_[i]));
-            if (swr < min_swr) {
-                min_swr = swr;
-                min_swr_i = i;
+        min_swr_i_ = 0;
+        for (size_t i=1; i<results_.len_; i++) {
+            if (results_[i].swr < results_[min_swr_i_].swr) {
+                min_swr_i_ = i;
             }
         }
+        min_swr_generation_ = results_.generation_;
+        min_swr_valid_ = true;
+        return min_swr_i_;
+    }
 
-        //draw the title
-        tft.fillRect(0, 0, tft.width()-8*TITLE_TEXT_SIZE*5, 8*TITLE_TEXT_SIZE*2, BLACK);
-        tft.setCursor(0,0);
-        tft.setTextSize(TITLE_TEXT_SIZE);
-
-        Complex min_g = analyzer_->calibrated_gamma(results_[min_swr_i]);
-        Complex sel_g = analyzer_->calibrated_gamma(results_[swr_i_]);
+    size_t draw_swr_title() {
+        if (results_.len_ == 0) {
+            title_min_.draw("No SWR results");
+            title_sel_.draw("");
+            return 0;
+        }
 
-        tft.println(String("Min @ ")+frequency_formatter(results_[min_swr_i].fq)+" "+compute_swr(min_g)+"SWR");
-        tft.println(String("Sel @ ")+frequency_formatter(results_[swr_i_].fq)+" "+compute_swr(sel_g)+"SWR");
+        // "Min 999.999MHz 99.99" just fits next to the battery
+        size_t min_i = min_swr_i();
+        String min_line = String("Min ")+frequency_formatter(results_.fq(min_i))+" "+swr_formatter(results_[min_i].swr);
+        String sel_line = String("Sel ")+frequency_formatter(results_.fq(swr_i_))+" "+swr_formatter(results_[swr_i_].swr);
+        title_min_.draw(min_line.c_str());
+        title_sel_.draw(sel_line.c_str());
 
-        return min_swr_i;
+        return min_i;
     }
 
     void draw_smith_coords(size_t min_swr_i) {
-        if(results_len_ == 0) {
+        if(results_.len_ == 0) {
             return;
         }
-        Complex min_g = analyzer_->calibrated_gamma(results_[min_swr_i]);
-        Complex min_z = compute_z(min_g, analyzer_->z0_);
-        Complex sel_g = analyzer_->calibrated_gamma(results_[swr_i_]);
-        Complex sel_z = compute_z(sel_g, analyzer_->z0_);
+        Complex min_z = results_[min_swr_i].z;
+        Complex sel_z = results_[swr_i_].z;
 
-        tft.fillRect(0, tft.height()-2*8*TITLE_TEXT_SIZE, tft.width(), 8*TITLE_TEXT_SIZE*2, BLACK);
-        tft.setCursor(0, tft.height()-2*8*TITLE_TEXT_SIZE);
-        tft.setTextSize(TITLE_TEXT_SIZE);
-        tft.println(String("Min X: ")+min_z.real()+" R: "+min_z.imag());
-        tft.println(String("Sel X: ")+sel_z.real()+" R: "+sel_z.imag());
+        String min_line = String("Min X: ")+min_z.real()+" R: "+min_z.imag();
+        String sel_line = String("Sel X: ")+sel_z.real()+" R: "+sel_z.imag();
+        coords_min_.draw(min_line.c_str());
+        coords_sel_.draw(sel_line.c_str());
     }
 
     void draw_smith_title() {
@@ -238,6 +366,15 @@ public:
         draw_smith_coords(min_swr_i);
     }
 
+    // something else (e.g. an error message) drew over the title or
+    // coordinates, so the next draw has to redraw them in full
+    void invalidate_text() {
+        title_min_.invalidate();
+        title_sel_.invalidate();
+        coords_min_.invalidate();
+        coords_sel_.invalidate();
+    }
+
     template<class T>
     void draw_smith_label(const T label, const Complex z) {
         int16_t label_xy[2];
@@ -245,40 +382,46 @@ public:
 
         label_g = compute_gamma(z, analyzer_->z0_);
         translate_to_screen(label_g.real(), label_g.imag(), label_xy);
-        tft.fillCircle(label_xy[0], label_xy[1], 2, WHITE);
-        tft.setCursor(label_xy[0]+6*LABEL_TEXT_SIZE/2, label_xy[1]+8*LABEL_TEXT_SIZE/2);
-        tft.print(label);
+        layer_dot(label_xy[0], label_xy[1], 2, WHITE);
+        layer_label(label_xy[0]+6*LABEL_TEXT_SIZE/2, label_xy[1]+8*LABEL_TEXT_SIZE/2, String(label), GRAY);
     }
 
     void graph_smith() {
-        graph_logger.info(String("graphing swr plot with ")+results_len_+" points");
-        pointer_patch_x = tft.width();
-        pointer_patch_y = tft.height();
+        graph_logger.info(String("graphing swr plot with ")+results_.len_+" points");
+        pointer_x_ = -1;
 
         // area is just below the title
         tft.fillRect(0, 5*2*8, tft.width(), 3*8*3, BLACK);
         tft.fillRect(0, 8*TITLE_TEXT_SIZE, tft.width(), tft.height()-8*TITLE_TEXT_SIZE, BLACK);
+        invalidate_text();
+
+        draw_smith_axes();
 
-        // draw axes
+        // draw all the analysis points
+        if (results_.len_ == 0) {
+            graph_logger.info(F("no results to plot"));
+            traced_len_ = 0;
+            return;
+        }
+        draw_trace();
+    }
+
+    void draw_smith_axes() {
+        clear_layers();
         // horizontal (and arcs) resistance axis
-        tft.drawFastHLine(x_screen_, y_screen_+(height_/2), width_, WHITE);
+        layer_hline(x_screen_, y_screen_+(height_/2), width_, WHITE);
         // circular reactance axis (radius 1, centered at (0.5, 0))
-        tft.drawCircle(x_screen_+(width_*3/4), y_screen_+(height_/2), width_/4, WHITE);
+        layer_circle(x_screen_+(width_*3/4), y_screen_+(height_/2), width_/4, WHITE);
         // and draw the outer circle for reference
-        tft.drawCircle(x_screen_+(width_/2), y_screen_+(height_/2), width_/2, WHITE);
+        layer_circle(x_screen_+(width_/2), y_screen_+(height_/2), width_/2, WHITE);
 
         // draw some axes labels: z=z0, z=z0*2, z=z0/2, z=1j, z=-1j
-        tft.setTextSize(LABEL_TEXT_SIZE);
-        tft.setTextColor(GRAY);
-
         draw_smith_label(analyzer_->z0_, Complex(analyzer_->z0_, 0));
         draw_smith_label(analyzer_->z0_*2, Complex(analyzer_->z0_*2.0, 0));
         draw_smith_label(analyzer_->z0_/2.0, Complex(analyzer_->z0_/2.0, 0));
         draw_smith_label(analyzer_->z0_, Complex(analyzer_->z0_, analyzer_->z0_));
         draw_smith_label(analyzer_->z0_, Complex(analyzer_->z0_, -analyzer_->z0_));
 
-        tft.setTextColor(WHITE);
-
         //cutoff swr circles
         int16_t center[2];
         translate_to_screen(0, 0, center);
@@ -287,69 +430,107 @@ public:
         translate_to_screen(0.5, 0, swr_3);
         assert(abs(compute_swr(Complex(0.5, 0))-3.0) < 0.001);
         swr_3[0] -= center[0];
-        tft.drawCircle(x_screen_+(width_/2), y_screen_+(height_/2), swr_3[0], RED);
+        layer_circle(x_screen_+(width_/2), y_screen_+(height_/2), swr_3[0], RED);
 
         int16_t swr_15[2];
         translate_to_screen(0.2, 0, swr_15);
         assert(abs(compute_swr(Complex(0.2, 0))-1.5) < 0.001);
         swr_15[0] -= center[0];
-        tft.drawCircle(x_screen_+width_/2, y_screen_+height_/2, swr_15[0], MAGENTA);
+        layer_circle(x_screen_+width_/2, y_screen_+height_/2, swr_15[0], MAGENTA);
+    }
 
-        // draw all the analysis points
-        if (results_len_ == 0) {
-            graph_logger.info(F("no results to plot"));
+    void draw_smith_pointer() {
+        if (results_.len_ == 0) {
             return;
-        } else if (results_len_ == 1) {
-            int16_t xy[2];
-            Complex g = analyzer_->calibrated_gamma(results_[0]);
-            translate_to_screen(g.real(), g.imag(), xy);
-            tft.fillCircle(xy[0], xy[1], 3, YELLOW);
-        } else {
-            for (size_t i=0; i<results_len_-1; i++) {
-                Complex g_start = analyzer_->calibrated_gamma(results_[i]);
-                Complex g_end = analyzer_->calibrated_gamma(results_[i+1]);
-                int16_t xy_start[2];
-                translate_to_screen(g_start.real(), g_start.imag(), xy_start);
-                int16_t xy_end[2];
-                translate_to_screen(g_end.real(), g_end.imag(), xy_end);
-                graph_logger.debug(String("drawing line ")+xy_start[0]+","+xy_start[1]+" to "+xy_end[0]+","+xy_end[1]);
-                tft.drawLine(xy_start[0], xy_start[1], xy_end[0], xy_end[1], YELLOW);
-            }
         }
+
+        int16_t xy_pointer[2];
+        point_xy(swr_i_, xy_pointer);
+        draw_pointer(xy_pointer);
     }
 
-    void draw_smith_pointer() {
-        if (results_len_ == 0) {
+    // live sweeps: point i was just measured (or re-measured), so erase the
+    // trace segments touching its old position and draw the new ones
+    // without redrawing the rest of the graph
+    void update_point(size_t i) {
+        if (i > traced_len_ || i >= results_.len_) {
             return;
         }
-
-        //first clear the old swr pointer
-        if(pointer_patch_x < tft.width() && pointer_patch_y < tft.height()) {
-            tft.drawRGBBitmap(pointer_patch_x, pointer_patch_y, pointer_patch, POINTER_WIDTH, POINTER_HEIGHT);
+        if (traced_len_ == 1 && i == 0) {
+            draw_point_marker(BLACK);
+        } else if (i < traced_len_) {
+            draw_segments(i, BLACK);
+        }
+        point_to_screen(i, trace_xy_[i]);
+        if (i == traced_len_) {
+            traced_len_++;
+        }
+        // only point i changed, so the rest of the trace is still current
+        trace_generation_ = results_.generation_;
+        trace_valid_ = true;
+        if (traced_len_ == 1) {
+            draw_point_marker(YELLOW);
+            return;
+        } else if (i == 1 && traced_len_ == 2) {
+            // the single point marker gets replaced by a line
+            draw_point_marker(BLACK);
+        }
+        draw_segments(i, YELLOW);
+        // erasing might have cut through the neighboring segments
+        if (i > 1) {
+            draw_segment(i-2, YELLOW);
         }
+        if (i+2 < traced_len_) {
+            draw_segment(i+1, YELLOW);
+        }
+    }
 
-        //draw the "pointer"
-        int16_t xy_pointer[2];
-        Complex gamma_pointer = analyzer_->calibrated_gamma(results_[swr_i_]);
-        translate_to_screen(gamma_pointer.real(), gamma_pointer.imag(), xy_pointer);
-        pointer_patch_x = xy_pointer[0]-POINTER_WIDTH/2;
-        pointer_patch_y = xy_pointer[1];
-        read_patch(pointer_patch_x, pointer_patch_y, POINTER_WIDTH, POINTER_HEIGHT, pointer_patch);
-        tft.drawTriangle(xy_pointer[0], xy_pointer[1], xy_pointer[0]-POINTER_WIDTH/2, xy_pointer[1]+POINTER_HEIGHT-1, xy_pointer[0]+POINTER_WIDTH/2-1, xy_pointer[1]+POINTER_HEIGHT-1, GREEN);
+    // repair axes that live updates erased parts of and refresh the title
+    void finish_live_pass() {
+        if (mode_ == GRAPH_SMITH) {
+            draw_smith_axes();
+            draw_smith_title();
+        } else {
+            draw_swr_axes();
+            draw_swr_title();
+        }
     }
 
     void incr_swri(int32_t turn) {
-        swr_i_ = constrain((int32_t)swr_i_+turn, 0, results_len_-1);
+        swr_i_ = constrain((int32_t)swr_i_+turn, 0, results_.len_-1);
     }
 
 private:
-    int16_t pointer_patch_x, pointer_patch_y;
-    uint16_t pointer_patch[POINTER_WIDTH*POINTER_HEIGHT];
+    // top left of the pointer, pointer_x_ is -1 while there's none
+    int16_t pointer_x_, pointer_y_;
     size_t swr_i_;
-    const AnalysisPoint* results_;
-    size_t results_len_;
+    const DerivedResults& results_;
     const Analyzer* analyzer_;
 
+    // screen position of every point as last drawn, so live updates can
+    // erase the old trace segments
+    uint8_t mode_;
+    int16_t trace_xy_[MAX_STEPS][2];
+    size_t traced_len_;
+    // results generation trace_xy_ was computed for, cleared when the
+    // axes change
+    uint32_t trace_generation_;
+    bool trace_valid_;
+
+    // titles and smith chart coordinates, redrawn a character at a time
+    TextField title_min_;
+    TextField title_sel_;
+    TextField coords_min_;
+    TextField coords_sel_;
+
+    size_t min_swr_i_;
+    uint32_t min_swr_generation_;
+    bool min_swr_valid_;
+
+    // frequency range of each SWR panel
+    size_t segments_;
+    uint32_t segment_fq_[MAX_PLAN_SEGMENTS][2];
+
     float x_min_;
     float x_max_;
     float y_min_;
@@ -359,14 +540,547 @@ private:
     int16_t y_screen_;
     int16_t width_;
     int16_t height_;
+    ClipRect clip_;
+    // while redrawing under the pointer, the only area to draw in
+    const ClipRect* damage_;
+
+    LayerItem layers_[MAX_LAYER_ITEMS];
+    size_t layers_len_;
+    char labels_[MAX_LAYER_LABELS][LAYER_LABEL_LEN];
+    size_t labels_len_;
+
+    // screen = graph * scale + offset
+    float x_scale_;
+    float x_offset_;
+    float y_scale_;
+    float y_offset_;
+
+    // move the pointer to xy unless it's already there, which is common
+    // with more points than pixels or at either end of the results
+    // points off the plot get the pointer on its edge, points that can't be
+    // drawn at all get none
+    void draw_pointer(int16_t* xy_pointer) {
+        if (xy_pointer[0] != TRACE_BREAK) {
+            xy_pointer[0] = constrain(xy_pointer[0], clip_.x0, clip_.x1);
+            xy_pointer[1] = constrain(xy_pointer[1], clip_.y0, clip_.y1);
+        }
+        if (pointer_x_ >= 0 && xy_pointer[0]-POINTER_WIDTH/2 == pointer_x_ && xy_pointer[1] == pointer_y_) {
+            return;
+        }
+
+        //first clear the old pointer
+        if (pointer_x_ >= 0) {
+            ClipRect old = { pointer_x_, pointer_y_, (int16_t)(pointer_x_+POINTER_WIDTH-1), (int16_t)(pointer_y_+POINTER_HEIGHT-1) };
+            redraw_area(old);
+            pointer_x_ = -1;
+        }
+        if (xy_pointer[0] == TRACE_BREAK) {
+            return;
+        }
+
+        //draw the "pointer"
+        pointer_x_ = xy_pointer[0]-POINTER_WIDTH/2;
+        pointer_y_ = xy_pointer[1];
+        tft.drawTriangle(xy_pointer[0], xy_pointer[1], xy_pointer[0]-POINTER_WIDTH/2, xy_pointer[1]+POINTER_HEIGHT-1, xy_pointer[0]+POINTER_WIDTH/2-1, xy_pointer[1]+POINTER_HEIGHT-1, GREEN);
+    }
+
+    // clear area and draw the layers and trace in it again, exactly as
+    // they were drawn before. dots and labels can't be drawn partially so
+    // the area grows to cover any it touches. text fields drawn over are
+    // left to be redrawn by the next title update.
+    void redraw_area(ClipRect area) {
+        for (size_t i=0; i<layers_len_; i++) {
+            ClipRect bounds;
+            if (layer_bounds(layers_[i], &bounds) && bounds.overlaps(area)) {
+                area.cover(bounds);
+            }
+        }
+        area.x0 = max(area.x0, (int16_t)0);
+        area.y0 = max(area.y0, (int16_t)0);
+        area.x1 = min(area.x1, (int16_t)(tft.width()-1));
+        area.y1 = min(area.y1, (int16_t)(tft.height()-1));
+        if (area.x0 > area.x1 || area.y0 > area.y1) {
+            return;
+        }
+
+        tft.fillRect(area.x0, area.y0, area.x1-area.x0+1, area.y1-area.y0+1, BLACK);
+        damage_ = &area;
+        tft.startWrite();
+        for (size_t i=0; i<layers_len_; i++) {
+            draw_layer(layers_[i], area);
+        }
+        tft.endWrite();
+        if (traced_len_ == 1) {
+            draw_point_marker(YELLOW);
+        } else if (mode_ == GRAPH_SMITH) {
+            draw_polyline(YELLOW);
+        } else {
+            draw_columns(YELLOW);
+        }
+        damage_ = NULL;
+
+        if (title_min_.overlaps(area.x0, area.y0, area.x1, area.y1)) {
+            title_min_.invalidate();
+        }
+        if (title_sel_.overlaps(area.x0, area.y0, area.x1, area.y1)) {
+            title_sel_.invalidate();
+        }
+        if (coords_min_.overlaps(area.x0, area.y0, area.x1, area.y1)) {
+            coords_min_.invalidate();
+        }
+        if (coords_sel_.overlaps(area.x0, area.y0, area.x1, area.y1)) {
+            coords_sel_.invalidate();
+        }
+    }
+
+    void clear_layers() {
+        layers_len_ = 0;
+        labels_len_ = 0;
+    }
+
+    void add_layer(uint8_t kind, int16_t x, int16_t y, int16_t size, uint16_t color) {
+        if (layers_len_ == MAX_LAYER_ITEMS) {
+            graph_logger.warn(F("too many graph layer items, pointer may leave marks"));
+            return;
+        }
+        LayerItem &item = layers_[layers_len_++];
+        item.kind = kind;
+        item.x = x;
+        item.y = y;
+        item.size = size;
+        item.color = color;
+    }
+
+    void layer_hline(int16_t x, int16_t y, int16_t w, uint16_t color) {
+        tft.drawFastHLine(x, y, w, color);
+        add_layer(LAYER_HLINE, x, y, w, color);
+    }
+
+    void layer_vline(int16_t x, int16_t y, int16_t h, uint16_t color) {
+        tft.drawFastVLine(x, y, h, color);
+        add_layer(LAYER_VLINE, x, y, h, color);
+    }
+
+    void layer_circle(int16_t x, int16_t y, int16_t r, uint16_t color) {
+        tft.drawCircle(x, y, r, color);
+        add_layer(LAYER_CIRCLE, x, y, r, color);
+    }
+
+    void layer_dot(int16_t x, int16_t y, int16_t r, uint16_t color) {
+        tft.fillCircle(x, y, r, color);
+        add_layer(LAYER_DOT, x, y, r, color);
+    }
+
+    void layer_label(int16_t x, int16_t y, const String &label, uint16_t color) {
+        draw_label(x, y, label.c_str(), color);
+        if (labels_len_ == MAX_LAYER_LABELS) {
+            graph_logger.warn(F("too many graph labels, pointer may leave marks"));
+            return;
+        }
+        strncpy(labels_[labels_len_], label.c_str(), LAYER_LABEL_LEN-1);
+        labels_[labels_len_][LAYER_LABEL_LEN-1] = '\0';
+        add_layer(LAYER_LABEL, x, y, labels_len_++, color);
+    }
+
+    void draw_label(int16_t x, int16_t y, const char* label, uint16_t color) {
+        tft.setTextSize(LABEL_TEXT_SIZE);
+        tft.setTextColor(color);
+        tft.setCursor(x, y);
+        tft.print(label);
+        tft.setTextColor(WHITE);
+    }
+
+    // pixels the item can touch, false for items that draw clipped so
+    // don't need the area grown around them
+    bool layer_bounds(const LayerItem &item, ClipRect* bounds) {
+        if (item.kind == LAYER_DOT) {
+            *bounds = { (int16_t)(item.x-item.size), (int16_t)(item.y-item.size), (int16_t)(item.x+item.size), (int16_t)(item.y+item.size) };
+            return true;
+        } else if (item.kind == LAYER_LABEL) {
+            int16_t w = strlen(labels_[item.size])*6*LABEL_TEXT_SIZE;
+            *bounds = { item.x, item.y, (int16_t)(item.x+w-1), (int16_t)(item.y+8*LABEL_TEXT_SIZE-1) };
+            return true;
+        }
+        return false;
+    }
+
+    // the part of item inside area, between startWrite and endWrite
+    void draw_layer(const LayerItem &item, const ClipRect &area) {
+        switch (item.kind) {
+            case LAYER_HLINE:
+                if (item.y >= area.y0 && item.y <= area.y1) {
+                    int16_t x0 = max(item.x, area.x0);
+                    int16_t x1 = min((int16_t)(item.x+item.size-1), area.x1);
+                    if (x0 <= x1) {
+                        tft.writeFastHLine(x0, item.y, x1-x0+1, item.color);
+                    }
+                }
+                break;
+            case LAYER_VLINE:
+                if (item.x >= area.x0 && item.x <= area.x1) {
+                    int16_t y0 = max(item.y, area.y0);
+                    int16_t y1 = min((int16_t)(item.y+item.size-1), area.y1);
+                    if (y0 <= y1) {
+                        tft.writeFastVLine(item.x, y0, y1-y0+1, item.color);
+                    }
+                }
+                break;
+            case LAYER_CIRCLE:
+                write_circle(item.x, item.y, item.size, item.color, area);
+                break;
+            case LAYER_DOT:
+                write_dot(item.x, item.y, item.size, item.color, area);
+                break;
+            case LAYER_LABEL: {
+                ClipRect bounds;
+                layer_bounds(item, &bounds);
+                if (bounds.overlaps(area)) {
+                    tft.endWrite();
+                    draw_label(item.x, item.y, labels_[item.size], item.color);
+                    tft.startWrite();
+                }
+                break;
+            }
+        }
+    }
+
+    // the pixels of drawCircle(x0, y0, r, color) that are inside area,
+    // same algorithm as Adafruit_GFX so they line up exactly
+    void write_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color, const ClipRect &area) {
+        ClipRect bounds = { (int16_t)(x0-r), (int16_t)(y0-r), (int16_t)(x0+r), (int16_t)(y0+r) };
+        if (!bounds.overlaps(area)) {
+            return;
+        }
+        int16_t f = 1 - r;
+        int16_t ddF_x = 1;
+        int16_t ddF_y = -2 * r;
+        int16_t x = 0;
+        int16_t y = r;
+
+        write_pixel(x0, y0 + r, color, area);
+        write_pixel(x0, y0 - r, color, area);
+        write_pixel(x0 + r, y0, color, area);
+        write_pixel(x0 - r, y0, color, area);
+        while (x < y) {
+            if (f >= 0) {
+                y--;
+                ddF_y += 2;
+                f += ddF_y;
+            }
+            x++;
+            ddF_x += 2;
+            f += ddF_x;
+
+            write_pixel(x0 + x, y0 + y, color, area);
+            write_pixel(x0 - x, y0 + y, color, area);
+            write_pixel(x0 + x, y0 - y, color, area);
+            write_pixel(x0 - x, y0 - y, color, area);
+            write_pixel(x0 + y, y0 + x, color, area);
+            write_pixel(x0 - y, y0 + x, color, area);
+            write_pixel(x0 + y, y0 - x, color, area);
+            write_pixel(x0 - y, y0 - x, color, area);
+        }
+    }
+
+    // fillCircle(x0, y0, r, color) inside area, again following
+    // Adafruit_GFX's fillCircle and fillCircleHelper
+    void write_dot(int16_t x0, int16_t y0, int16_t r, uint16_t color, const ClipRect &area) {
+        write_vline(x0, y0 - r, 2 * r + 1, color, area);
+        int16_t f = 1 - r;
+        int16_t ddF_x = 1;
+        int16_t ddF_y = -2 * r;
+        int16_t x = 0;
+        int16_t y = r;
+        int16_t px = x;
+        int16_t py = y;
+        while (x < y) {
+            if (f >= 0) {
+                y--;
+                ddF_y += 2;
+                f += ddF_y;
+            }
+            x++;
+            ddF_x += 2;
+            f += ddF_x;
+            if (x < (y + 1)) {
+                write_vline(x0 + x, y0 - y, 2 * y + 1, color, area);
+                write_vline(x0 - x, y0 - y, 2 * y + 1, color, area);
+            }
+            if (y != py) {
+                write_vline(x0 + py, y0 - px, 2 * px + 1, color, area);
+                write_vline(x0 - py, y0 - px, 2 * px + 1, color, area);
+                py = y;
+            }
+            px = x;
+        }
+    }
+
+    void write_pixel(int16_t x, int16_t y, uint16_t color, const ClipRect &area) {
+        if (area.contains(x, y)) {
+            tft.writePixel(x, y, color);
+        }
+    }
+
+    void write_vline(int16_t x, int16_t y, int16_t h, uint16_t color, const ClipRect &area) {
+        if (x < area.x0 || x > area.x1) {
+            return;
+        }
+        int16_t y0 = max(y, area.y0);
+        int16_t y1 = min((int16_t)(y+h-1), area.y1);
+        if (y0 <= y1) {
+            tft.writeFastVLine(x, y0, y1-y0+1, color);
+        }
+    }
+
+    void point_to_screen(size_t i, int16_t* xy) {
+        if (mode_ == GRAPH_SMITH) {
+            Complex g = results_[i].gamma;
+            translate_to_screen(g.real(), g.imag(), xy);
+        } else {
+            translate_to_screen(fq_to_x(results_.fq(i)), results_[i].swr, xy);
+        }
+    }
+
+    // x axis position of fq: which panel it's in plus how far across it
+    float fq_to_x(uint32_t fq) {
+        size_t s = 0;
+        while (s+1 < segments_ && fq > segment_fq_[s][1]) {
+            s++;
+        }
+        uint32_t start_fq = segment_fq_[s][0];
+        uint32_t end_fq = segment_fq_[s][1];
+        if (end_fq <= start_fq) {
+            // a single point segment goes in the middle of its panel
+            return s + 0.5;
+        }
+        fq = constrain(fq, start_fq, end_fq);
+        return s + (float)(fq - start_fq) / (float)(end_fq - start_fq);
+    }
+
+    // the trace is where the current results go with the current axes
+    bool trace_current() {
+        return trace_valid_ && trace_generation_ == results_.generation_;
+    }
+
+    // screen position of point i, from the trace when it's current
+    void point_xy(size_t i, int16_t* xy) {
+        if (trace_current() && i < traced_len_) {
+            xy[0] = trace_xy_[i][0];
+            xy[1] = trace_xy_[i][1];
+        } else {
+            point_to_screen(i, xy);
+        }
+    }
+
+    void draw_trace() {
+        if (!trace_current()) {
+            for (size_t i=0; i<results_.len_; i++) {
+                point_to_screen(i, trace_xy_[i]);
+            }
+            traced_len_ = results_.len_;
+            trace_generation_ = results_.generation_;
+            trace_valid_ = true;
+        }
+        if (traced_len_ == 1) {
+            draw_point_marker(YELLOW);
+            return;
+        }
+        if (mode_ == GRAPH_SMITH) {
+            draw_polyline(YELLOW);
+        } else {
+            draw_columns(YELLOW);
+        }
+    }
+
+    // swr trace as one vertical span per screen column covering every
+    // point in it, plus a line over from the previous column. with more
+    // points than columns this bounds drawing by the plot width instead
+    // of the number of points.
+    void draw_columns(uint16_t color) {
+        tft.startWrite();
+        size_t i = 0;
+        while (i < traced_len_) {
+            if (trace_xy_[i][0] == TRACE_BREAK) {
+                i++;
+                continue;
+            }
+            int16_t x = trace_xy_[i][0];
+            int16_t y_min = trace_xy_[i][1];
+            int16_t y_max = y_min;
+            size_t j = i+1;
+            while (j < traced_len_ && trace_xy_[j][0] == x && joined(j-1, j)) {
+                y_min = min(y_min, trace_xy_[j][1]);
+                y_max = max(y_max, trace_xy_[j][1]);
+                j++;
+            }
+            if (i > 0 && joined(i-1, i)) {
+                write_line(trace_xy_[i-1][0], trace_xy_[i-1][1], x, trace_xy_[i][1], color);
+            }
+            if (y_max > y_min) {
+                write_line(x, y_min, x, y_max, color);
+            }
+            i = j;
+        }
+        tft.endWrite();
+    }
+
+    // smith trace, skipping points that land on the same pixel as the end
+    // of the line so far
+    void draw_polyline(uint16_t color) {
+        tft.startWrite();
+        size_t last = 0;
+        for (size_t i=1; i<traced_len_; i++) {
+            if (!joined(last, i)) {
+                last = i;
+                continue;
+            }
+            if (trace_xy_[i][0] == trace_xy_[last][0] && trace_xy_[i][1] == trace_xy_[last][1]) {
+                continue;
+            }
+            write_line(trace_xy_[last][0], trace_xy_[last][1], trace_xy_[i][0], trace_xy_[i][1], color);
+            last = i;
+        }
+        tft.endWrite();
+    }
+
+    // segment from point i to point i+1
+    void draw_segment(size_t i, uint16_t color) {
+        if (!joined(i, i+1)) {
+            return;
+        }
+        if (graph_logger.enabled(LOG_DEBUG)) {
+            graph_logger.debug(String("drawing line ")+trace_xy_[i][0]+","+trace_xy_[i][1]+" to "+trace_xy_[i+1][0]+","+trace_xy_[i+1][1]);
+        }
+        tft.startWrite();
+        write_line(trace_xy_[i][0], trace_xy_[i][1], trace_xy_[i+1][0], trace_xy_[i+1][1], color);
+        tft.endWrite();
+    }
+
+    // both segments touching point i
+    void draw_segments(size_t i, uint16_t color) {
+        if (i > 0) {
+            draw_segment(i-1, color);
+        }
+        if (i+1 < traced_len_) {
+            draw_segment(i, color);
+        }
+    }
 
+    // the trace runs from point a to point b unless one of them can't be
+    // drawn or they're in different plan segments
+    bool joined(size_t a, size_t b) {
+        return trace_xy_[a][0] != TRACE_BREAK && trace_xy_[b][0] != TRACE_BREAK && results_.segment(a) == results_.segment(b);
+    }
+
+    // the marker for a trace of just one point
+    void draw_point_marker(uint16_t color) {
+        if (trace_xy_[0][0] == TRACE_BREAK || clip_.outcode(trace_xy_[0][0], trace_xy_[0][1]) != 0) {
+            return;
+        }
+        if (damage_) {
+            tft.startWrite();
+            write_dot(trace_xy_[0][0], trace_xy_[0][1], 3, color, *damage_);
+            tft.endWrite();
+        } else {
+            tft.fillCircle(trace_xy_[0][0], trace_xy_[0][1], 3, color);
+        }
+    }
+
+    // the part of a line inside the plot, between startWrite and endWrite
+    // straight lines go through the fast line calls like drawLine does
+    void write_line(int16_t xa, int16_t ya, int16_t xb, int16_t yb, uint16_t color) {
+        if (!clip_.clip(&xa, &ya, &xb, &yb)) {
+            return;
+        }
+        if (damage_) {
+            write_damaged_line(xa, ya, xb, yb, color, *damage_);
+        } else if (xa == xb) {
+            tft.writeFastVLine(xa, min(ya, yb), abs(yb - ya) + 1, color);
+        } else if (ya == yb) {
+            tft.writeFastHLine(min(xa, xb), ya, abs(xb - xa) + 1, color);
+        } else {
+            tft.writeLine(xa, ya, xb, yb, color);
+        }
+    }
+
+    // the pixels of a line inside area, following Adafruit_GFX's writeLine
+    // over the whole line so they match what was drawn before
+    void write_damaged_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color, const ClipRect &area) {
+        ClipRect bounds = { min(x0, x1), min(y0, y1), max(x0, x1), max(y0, y1) };
+        if (!bounds.overlaps(area)) {
+            return;
+        }
+        if (x0 == x1) {
+            write_vline(x0, bounds.y0, bounds.y1-bounds.y0+1, color, area);
+            return;
+        } else if (y0 == y1) {
+            int16_t xa = max(bounds.x0, area.x0);
+            int16_t xb = min(bounds.x1, area.x1);
+            if (y0 >= area.y0 && y0 <= area.y1 && xa <= xb) {
+                tft.writeFastHLine(xa, y0, xb-xa+1, color);
+            }
+            return;
+        }
+        int16_t t;
+        bool steep = abs(y1 - y0) > abs(x1 - x0);
+        if (steep) {
+            t = x0; x0 = y0; y0 = t;
+            t = x1; x1 = y1; y1 = t;
+        }
+        if (x0 > x1) {
+            t = x0; x0 = x1; x1 = t;
+            t = y0; y0 = y1; y1 = t;
+        }
+        int16_t dx = x1 - x0;
+        int16_t dy = abs(y1 - y0);
+        int16_t err = dx / 2;
+        int16_t ystep = y0 < y1 ? 1 : -1;
+        for (; x0 <= x1; x0++) {
+            if (steep) {
+                write_pixel(y0, x0, color, area);
+            } else {
+                write_pixel(x0, y0, color, area);
+            }
+            err -= dy;
+            if (err < 0) {
+                y0 += ystep;
+                err += dx;
+            }
+        }
+    }
+
+    // after the axes change: the graph to screen mapping as a scale and
+    // offset, and the clip rectangle, which is the plot area or as much of
+    // it as is on screen
+    void set_mapping() {
+        x_scale_ = width_ / (x_max_ - x_min_);
+        y_scale_ = height_ / (y_max_ - y_min_);
+        x_offset_ = x_screen_ - x_min_ * x_scale_;
+        y_offset_ = y_screen_ - y_min_ * y_scale_;
+        trace_valid_ = false;
+
+        clip_.x0 = max(x_screen_, (int16_t)0);
+        clip_.y0 = max(y_screen_, (int16_t)0);
+        clip_.x1 = min((int16_t)(x_screen_ + width_), (int16_t)(tft.width() - 1));
+        clip_.y1 = min((int16_t)(y_screen_ + height_), (int16_t)(tft.height() - 1));
+    }
+
+    // positions that aren't finite (e.g. infinite SWR) come back as
+    // TRACE_BREAK, see TRACE_COORD_LIMIT for ones far off the plot
     void translate_to_screen(float x_in, float y_in, int16_t* xy) {
-        float x_range = x_max_ - x_min_;
-        float y_range = y_max_ - y_min_;
-        xy[0] = (x_in - x_min_) / x_range * width_ + x_screen_;
-        xy[1] = (y_in - y_min_) / y_range * height_ + y_screen_;
+        float x = x_in * x_scale_ + x_offset_;
+        float y = y_in * y_scale_ + y_offset_;
+        if (!isfinite(x) || !isfinite(y)) {
+            xy[0] = TRACE_BREAK;
+            xy[1] = TRACE_BREAK;
+        } else {
+            xy[0] = constrain(x, (float)-TRACE_COORD_LIMIT, (float)TRACE_COORD_LIMIT);
+            xy[1] = constrain(y, (float)-TRACE_COORD_LIMIT, (float)TRACE_COORD_LIMIT);
+        }
 
-        graph_logger.debug(String(x_in)+" -> "+xy[0]+" "+y_in+" -> "+xy[1]);
+        if (graph_logger.enabled(LOG_DEBUG)) {
+            graph_logger.debug(String(x_in)+" -> "+xy[0]+" "+y_in+" -> "+xy[1]);
+        }
     }
 };
 
@@ -0,0 +1,288 @@
+#ifndef _JSON_TOKENIZER_H
+#define _JSON_TOKENIZER_H
+
+#include "log.h"
+
+Logger json_logger("json");
+
+// longest key or value we keep, enough for any float printed with 6
+// decimals. longer strings are cut off (so keys never match anything in our
+// schemas), longer numbers are an error
+#define JSON_SCRATCH_LEN 48
+// deepest nesting we accept, our files go 4 deep
+#define JSON_MAX_DEPTH 16
+
+// A key or value as it came from the tokenizer. Numbers are accumulated
+// while they're read so the common case converts without going through the
+// text again.
+struct JsonValue {
+    char text_[JSON_SCRATCH_LEN];
+    size_t len_;
+
+    // a plain decimal number that fits the fast paths below
+    bool simple_;
+    bool negative_;
+    bool fraction_;
+    uint64_t mantissa_;
+    uint8_t digits_;
+    // power of ten to scale mantissa_ by, i.e. minus the digits after the
+    // point
+    int16_t exponent_;
+
+    void clear() {
+        len_ = 0;
+        text_[0] = '\0';
+        simple_ = true;
+        negative_ = false;
+        fraction_ = false;
+        mantissa_ = 0;
+        digits_ = 0;
+        exponent_ = 0;
+    }
+
+    bool push(char c) {
+        if(len_ == sizeof(text_) - 1) {
+            return false;
+        }
+        if(c >= '0' && c <= '9') {
+            if(mantissa_ == 0 && c == '0') {
+                // leading zeros don't count against precision
+            } else if(digits_ < 19) {
+                mantissa_ = mantissa_*10 + (c - '0');
+                digits_++;
+            } else {
+                simple_ = false;
+            }
+            if(fraction_) {
+                exponent_--;
+            }
+        } else if(c == '-' && len_ == 0) {
+            negative_ = true;
+        } else if(c == '.' && !fraction_) {
+            fraction_ = true;
+        } else {
+            // exponents, literals and anything odd go through libc
+            simple_ = false;
+        }
+        text_[len_++] = c;
+        text_[len_] = '\0';
+        return true;
+    }
+
+    bool equals(const char* s) const {
+        return strcmp(text_, s) == 0;
+    }
+
+    // same result as atof(), which is what we used to parse with
+    double to_double() const {
+        // up to 15 digits and 22 powers of ten are exact in a double, so a
+        // single division or multiplication rounds the same as strtod
+        if(!simple_ || digits_ > 15 || exponent_ < -22 || len_ == 0 || (negative_ && len_ == 1)) {
+            return atof(text_);
+        }
+        double v = (double)mantissa_;
+        if(exponent_ < 0) {
+            v /= power_of_ten(-exponent_);
+        }
+        return negative_ ? -v : v;
+    }
+
+    float to_float() const {
+        return to_double();
+    }
+
+    // same result as atoi()
+    long to_long() const {
+        if(!simple_ || fraction_ || digits_ > 9 || len_ == 0) {
+            return atoi(text_);
+        }
+        return negative_ ? -(long)mantissa_ : (long)mantissa_;
+    }
+
+    static double power_of_ten(int n) {
+        static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        return powers[n];
+    }
+};
+
+// Streaming JSON tokenizer that works out of fixed buffers and never
+// allocates. Feed it a character at a time with parse(), it calls listener
+// methods as it goes:
+//  startDocument(), endDocument()
+//  startObject(), endObject(), startArray(), endArray()
+//  key(const JsonValue&), value(const JsonValue&)
+// Strings and bare literals (numbers, true, false, null) are both values,
+// listeners convert them as their schema needs.
+class JsonTokenizer {
+    public:
+        JsonTokenizer() {
+            reset();
+        }
+
+        void reset() {
+            state_ = JSON_START_DOCUMENT;
+            depth_ = 0;
+            expect_key_ = false;
+            has_error_ = false;
+        }
+
+        template<class T>
+        void parse(char c, T* listener) {
+            switch(state_) {
+                case JSON_IN_STRING:
+                    if(escape_) {
+                        escape_ = false;
+                        push(unescape(c));
+                    } else if(c == '\\') {
+                        escape_ = true;
+                    } else if(c == '"') {
+                        state_ = JSON_AFTER_VALUE;
+                        if(string_is_key_) {
+                            listener->key(scratch_);
+                        } else {
+                            listener->value(scratch_);
+                        }
+                    } else {
+                        push(c);
+                    }
+                    return;
+                case JSON_IN_LITERAL:
+                    if((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || (c >= 'a' && c <= 'z') || c == 'E') {
+                        if(!scratch_.push(c)) {
+                            error("number too long");
+                        }
+                        return;
+                    }
+                    state_ = JSON_AFTER_VALUE;
+                    listener->value(scratch_);
+                    // c ends the literal and still needs handling
+                    break;
+                case JSON_START_DOCUMENT:
+                    if(c != '{' && c != '[') {
+                        return;
+                    }
+                    listener->startDocument();
+                    break;
+                case JSON_DONE:
+                case JSON_ERROR:
+                    return;
+                default:
+                    break;
+            }
+            structural(c, listener);
+        }
+
+        bool done() const {
+            return state_ == JSON_DONE;
+        }
+
+        bool has_error_;
+
+    private:
+        enum State { JSON_START_DOCUMENT, JSON_IN_CONTAINER, JSON_AFTER_VALUE, JSON_IN_STRING, JSON_IN_LITERAL, JSON_DONE, JSON_ERROR };
+
+        template<class T>
+        void structural(char c, T* listener) {
+            switch(c) {
+                case ' ':
+                case '\t':
+                case '\n':
+                case '\r':
+                    return;
+                case '{':
+                case '[':
+                    if(depth_ == JSON_MAX_DEPTH) {
+                        error("nested too deep");
+                        return;
+                    }
+                    in_object_[depth_++] = c == '{';
+                    expect_key_ = c == '{';
+                    state_ = JSON_IN_CONTAINER;
+                    if(c == '{') {
+                        listener->startObject();
+                    } else {
+                        listener->startArray();
+                    }
+                    return;
+                case '}':
+                case ']':
+                    if(depth_ == 0) {
+                        return;
+                    }
+                    depth_--;
+                    state_ = JSON_AFTER_VALUE;
+                    expect_key_ = false;
+                    if(c == '}') {
+                        listener->endObject();
+                    } else {
+                        listener->endArray();
+                    }
+                    if(depth_ == 0) {
+                        state_ = JSON_DONE;
+                        listener->endDocument();
+                    }
+                    return;
+                case ',':
+                    state_ = JSON_IN_CONTAINER;
+                    expect_key_ = depth_ > 0 && in_object_[depth_-1];
+                    return;
+                case ':':
+                    state_ = JSON_IN_CONTAINER;
+                    expect_key_ = false;
+                    return;
+                case '"':
+                    string_is_key_ = expect_key_;
+                    expect_key_ = false;
+                    escape_ = false;
+                    scratch_.clear();
+                    // keys never take part in number conversion
+                    scratch_.simple_ = false;
+                    state_ = JSON_IN_STRING;
+                    return;
+                default:
+                    scratch_.clear();
+                    if(!scratch_.push(c)) {
+                        error("number too long");
+                        return;
+                    }
+                    state_ = JSON_IN_LITERAL;
+            }
+        }
+
+        void push(char c) {
+            if(scratch_.len_ < sizeof(scratch_.text_) - 1) {
+                scratch_.text_[scratch_.len_++] = c;
+                scratch_.text_[scratch_.len_] = '\0';
+            }
+        }
+
+        char unescape(char c) {
+            switch(c) {
+                case 'n': return '\n';
+                case 't': return '\t';
+                case 'r': return '\r';
+                case 'b': return '\b';
+                case 'f': return '\f';
+                default: return c;
+            }
+        }
+
+        void error(const char* what) {
+            json_logger.warn(String(what)+": "+scratch_.text_);
+            has_error_ = true;
+            state_ = JSON_ERROR;
+        }
+
+        uint8_t state_;
+        JsonValue scratch_;
+        bool in_object_[JSON_MAX_DEPTH];
+        size_t depth_;
+        bool expect_key_;
+        bool string_is_key_;
+        bool escape_;
+};
+
+#endif //_JSON_TOKENIZER_H
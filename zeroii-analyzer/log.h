@@ -27,6 +27,15 @@ public:
 #endif
     }
 
+    // check before building an expensive message
+    bool enabled(uint8_t level) {
+#ifndef DISABLE_LOG
+        return level_ >= level;
+#else
+        return false;
+#endif
+    }
+
     void log(uint8_t level, const char* message) {
 #ifndef DISABLE_LOG
         if(level_ >= level) {
@@ -0,0 +1,359 @@
+#ifndef _MANIFEST_H
+#define _MANIFEST_H
+
+#include <SdFat.h>
+
+#include "log.h"
+#include "bytes.h"
+#include "file_stream.h"
+
+Logger manifest_logger("manifest");
+
+// Each of the settings and results directories keeps a manifest so naming
+// the next file, finding the latest one and browsing don't have to walk
+// the directory. The file is:
+//  a header of MANIFEST_HEADER_SIZE bytes:
+//   magic (4 bytes), version (u16), entry count (u16), next file number
+//   (u32), index of the highest numbered entry (u16, MANIFEST_NONE if
+//   there isn't one)
+//  one MANIFEST_ENTRY_SIZE entry per file, in the order they were added:
+//   name (MANIFEST_NAME_LEN bytes, zero padded), FAT date and time (u32),
+//   points (u16), first fq (u32), last fq (u32), min SWR (f32), fq of the
+//   min SWR (u32)
+// Entries are appended or rewritten in place on every save. The header is
+// written last, so a save cut short leaves a manifest whose size doesn't
+// match its count. That, a file already using the next number, or
+// invalidate() makes it stale, and the next access rebuilds it from the
+// directory.
+#define MANIFEST_FILE_NAME "manifest.idx"
+#define MANIFEST_MAGIC "ZIIM"
+#define MANIFEST_VERSION 1
+#define MANIFEST_HEADER_SIZE 16
+#define MANIFEST_NAME_LEN 32
+#define MANIFEST_ENTRY_SIZE 56
+#define MANIFEST_NONE 0xFFFF
+// entries never go past this, that's more files than FAT is happy with in
+// one directory anyway
+#define MANIFEST_MAX_ENTRIES 0xFFFE
+
+// what we know about a file without opening it
+struct ManifestEntry {
+    char name[MANIFEST_NAME_LEN];
+    // FAT date in the high half, time in the low half
+    uint32_t timestamp;
+    uint16_t points;
+    uint32_t start_fq;
+    uint32_t end_fq;
+    // NAN when there's no SWR (settings) or it isn't known (JSON results)
+    float min_swr;
+    uint32_t min_swr_fq;
+
+    void clear() {
+        memset(name, 0, sizeof(name));
+        timestamp = 0;
+        points = 0;
+        start_fq = 0;
+        end_fq = 0;
+        min_swr = NAN;
+        min_swr_fq = 0;
+    }
+
+    void to_bytes(uint8_t* data) const {
+        memcpy(data, name, MANIFEST_NAME_LEN);
+        put_u32(data+32, timestamp);
+        put_u16(data+36, points);
+        put_u16(data+38, 0);
+        put_u32(data+40, start_fq);
+        put_u32(data+44, end_fq);
+        put_f32(data+48, min_swr);
+        put_u32(data+52, min_swr_fq);
+    }
+
+    void from_bytes(const uint8_t* data) {
+        memcpy(name, data, MANIFEST_NAME_LEN);
+        name[MANIFEST_NAME_LEN-1] = '\0';
+        timestamp = get_u32(data+32);
+        points = get_u16(data+36);
+        start_fq = get_u32(data+40);
+        end_fq = get_u32(data+44);
+        min_swr = get_f32(data+48);
+        min_swr_fq = get_u32(data+52);
+    }
+};
+
+// number after prefix in name, or -1 if name doesn't start with prefix and
+// a number
+int32_t manifest_file_number(const char* name, const char* prefix) {
+    size_t prefix_len = strlen(prefix);
+    if(strncmp(name, prefix, prefix_len) != 0 || name[prefix_len] < '0' || name[prefix_len] > '9') {
+        return -1;
+    }
+    int32_t number = 0;
+    for(const char* c = name+prefix_len; *c >= '0' && *c <= '9'; c++) {
+        number = number*10 + (*c - '0');
+    }
+    return number;
+}
+
+typedef bool (*SummarizeFn)(FsFile* directory, const char* name, ManifestEntry* entry);
+
+class DirectoryManifest {
+    public:
+        DirectoryManifest() {
+            directory_ = NULL;
+            checked_ = false;
+            stale_ = false;
+        }
+
+        // summarize is how a rebuild learns about each file in directory
+        // extension is what automatically numbered files end in
+        void initialize(FsFile* directory, const char* prefix, const char* extension, SummarizeFn summarize) {
+            directory_ = directory;
+            prefix_ = prefix;
+            extension_ = extension;
+            summarize_ = summarize;
+            checked_ = false;
+            stale_ = false;
+        }
+
+        // something changed the directory behind our back
+        void invalidate() {
+            checked_ = false;
+            stale_ = true;
+        }
+
+        // makes sure the manifest matches the directory, rebuilding it if
+        // it doesn't. cheap after the first call.
+        bool refresh() {
+            if(checked_) {
+                return true;
+            }
+            if(stale_ || !read_header()) {
+                return rebuild();
+            }
+            // a save that finished without updating the manifest
+            char name[MANIFEST_NAME_LEN];
+            next_name(name, sizeof(name));
+            FsFile next;
+            if(next.open(directory_, name, O_RDONLY)) {
+                next.close();
+                manifest_logger.info(String(name)+" isn't in the manifest");
+                return rebuild();
+            }
+            checked_ = true;
+            return true;
+        }
+
+        size_t count() {
+            return refresh() ? count_ : 0;
+        }
+
+        // name for the next automatically numbered file
+        void next_name(char* name, size_t len) {
+            snprintf(name, len, "%s%lu%s", prefix_, (unsigned long)next_, extension_);
+        }
+
+        bool entry(size_t i, ManifestEntry* entry) {
+            if(!refresh() || i >= count_) {
+                return false;
+            }
+            FsFile file;
+            uint8_t data[MANIFEST_ENTRY_SIZE];
+            if(!file.open(directory_, MANIFEST_FILE_NAME, O_RDONLY) || !file.seekSet(MANIFEST_HEADER_SIZE + i*MANIFEST_ENTRY_SIZE) || file.read(data, sizeof(data)) != sizeof(data)) {
+                manifest_logger.error(String("could not read manifest entry ")+i);
+                invalidate();
+                return false;
+            }
+            file.close();
+            entry->from_bytes(data);
+            return true;
+        }
+
+        // the highest numbered file
+        bool latest(ManifestEntry* entry) {
+            return refresh() && latest_ != MANIFEST_NONE && this->entry(latest_, entry);
+        }
+
+        // record a file that was just saved, replacing its old entry if it
+        // has one
+        bool update(const ManifestEntry &entry) {
+            if(strlen(entry.name) >= MANIFEST_NAME_LEN-1) {
+                // cut off, it can't be found again
+                manifest_logger.warn(String("name too long for the manifest: ")+entry.name);
+                return false;
+            }
+            if(!refresh()) {
+                return false;
+            }
+            FsFile file;
+            if(!file.open(directory_, MANIFEST_FILE_NAME, O_RDWR)) {
+                invalidate();
+                return false;
+            }
+            // nothing numbered next_ or higher is in the manifest yet, so new
+            // automatically named files skip the search
+            int32_t number = manifest_file_number(entry.name, prefix_);
+            size_t i = number >= 0 && (uint32_t)number >= next_ ? count_ : find(&file, entry.name);
+            if(i == count_ && count_ == MANIFEST_MAX_ENTRIES) {
+                manifest_logger.error(F("manifest is full"));
+                file.close();
+                return false;
+            }
+            uint8_t data[MANIFEST_ENTRY_SIZE];
+            entry.to_bytes(data);
+            bool ok = file.seekSet(MANIFEST_HEADER_SIZE + i*MANIFEST_ENTRY_SIZE) && file.write(data, sizeof(data)) == sizeof(data);
+            if(i == count_) {
+                count_++;
+            }
+            note_number(entry.name, i);
+            ok = ok && write_header(&file);
+            file.close();
+            if(!ok) {
+                manifest_logger.error(String("could not add ")+entry.name+" to the manifest");
+                invalidate();
+            }
+            return ok;
+        }
+
+    private:
+        // index of the entry called name, or count_ if there isn't one
+        size_t find(FsFile* file, const char* name) {
+            if(!file->seekSet(MANIFEST_HEADER_SIZE)) {
+                return count_;
+            }
+            FileReader in(file);
+            uint8_t data[MANIFEST_ENTRY_SIZE];
+            for(size_t i=0; i<count_; i++) {
+                if(in.read(data, sizeof(data)) != sizeof(data)) {
+                    break;
+                }
+                if(strncmp((const char*)data, name, MANIFEST_NAME_LEN) == 0) {
+                    return i;
+                }
+            }
+            return count_;
+        }
+
+        // keep next_ and latest_ up to date with entry i called name
+        void note_number(const char* name, size_t i) {
+            int32_t number = manifest_file_number(name, prefix_);
+            if(number >= 0 && (uint32_t)number >= next_) {
+                next_ = number + 1;
+                latest_ = i;
+            }
+        }
+
+        bool read_header() {
+            FsFile file;
+            uint8_t header[MANIFEST_HEADER_SIZE];
+            if(!file.open(directory_, MANIFEST_FILE_NAME, O_RDONLY)) {
+                manifest_logger.info(F("no manifest yet"));
+                return false;
+            }
+            bool ok = file.read(header, sizeof(header)) == sizeof(header)
+                && memcmp(header, MANIFEST_MAGIC, 4) == 0
+                && get_u16(header+4) == MANIFEST_VERSION;
+            if(ok) {
+                count_ = get_u16(header+6);
+                next_ = get_u32(header+8);
+                latest_ = get_u16(header+12);
+                ok = file.size() == MANIFEST_HEADER_SIZE + (uint32_t)count_*MANIFEST_ENTRY_SIZE
+                    && (latest_ == MANIFEST_NONE || latest_ < count_);
+            }
+            file.close();
+            if(!ok) {
+                manifest_logger.warn(F("manifest is damaged"));
+            }
+            return ok;
+        }
+
+        bool write_header(FsFile* file) {
+            uint8_t header[MANIFEST_HEADER_SIZE];
+            memset(header, 0, sizeof(header));
+            memcpy(header, MANIFEST_MAGIC, 4);
+            put_u16(header+4, MANIFEST_VERSION);
+            put_u16(header+6, count_);
+            put_u32(header+8, next_);
+            put_u16(header+12, latest_);
+            return file->seekSet(0) && file->write(header, sizeof(header)) == sizeof(header);
+        }
+
+        // walk the directory once and summarize every file in it
+        bool rebuild() {
+            manifest_logger.info(F("rebuilding manifest"));
+            count_ = 0;
+            next_ = 0;
+            latest_ = MANIFEST_NONE;
+
+            // collect the names first, summarize reads files through the
+            // stream buffer that out holds while we walk the directory
+            FsFile file;
+            if(!file.open(directory_, MANIFEST_FILE_NAME, O_RDWR | O_CREAT | O_TRUNC) || !write_header(&file)) {
+                manifest_logger.error(F("could not create manifest"));
+                return false;
+            }
+            bool ok = true;
+            {
+                FileWriter out(&file);
+                FsFile child;
+                char name[MANIFEST_NAME_LEN+1];
+                uint8_t data[MANIFEST_ENTRY_SIZE];
+                ManifestEntry entry;
+                directory_->rewindDirectory();
+                while(child.openNext(directory_, O_RDONLY) && count_ < MANIFEST_MAX_ENTRIES) {
+                    size_t len = child.getName(name, sizeof(name));
+                    bool skip = child.isDirectory() || strcmp(name, MANIFEST_FILE_NAME) == 0;
+                    child.close();
+                    if(skip) {
+                        continue;
+                    }
+                    if(len >= MANIFEST_NAME_LEN) {
+                        manifest_logger.warn(String("name too long for the manifest: ")+name);
+                        continue;
+                    }
+                    entry.clear();
+                    strcpy(entry.name, name);
+                    entry.to_bytes(data);
+                    out.write(data, sizeof(data));
+                    note_number(name, count_);
+                    count_++;
+                }
+                ok = out.flush();
+            }
+
+            // then fill in the summaries
+            for(size_t i=0; ok && i<count_; i++) {
+                uint8_t data[MANIFEST_ENTRY_SIZE];
+                ManifestEntry entry;
+                ok = file.seekSet(MANIFEST_HEADER_SIZE + i*MANIFEST_ENTRY_SIZE) && file.read(data, sizeof(data)) == sizeof(data);
+                entry.from_bytes(data);
+                if(ok && summarize_(directory_, entry.name, &entry)) {
+                    entry.to_bytes(data);
+                    ok = file.seekSet(MANIFEST_HEADER_SIZE + i*MANIFEST_ENTRY_SIZE) && file.write(data, sizeof(data)) == sizeof(data);
+                }
+            }
+            ok = ok && write_header(&file);
+            file.close();
+            if(!ok) {
+                manifest_logger.error(F("could not write manifest"));
+                return false;
+            }
+            stale_ = false;
+            checked_ = true;
+            manifest_logger.info(String("manifest has ")+count_+" files");
+            return true;
+        }
+
+        FsFile* directory_;
+        const char* prefix_;
+        const char* extension_;
+        SummarizeFn summarize_;
+
+        bool checked_;
+        bool stale_;
+        uint16_t count_;
+        uint32_t next_;
+        uint16_t latest_;
+};
+
+#endif //_MANIFEST_H
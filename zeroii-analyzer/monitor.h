@@ -0,0 +1,188 @@
+#ifndef _MONITOR_H
+#define _MONITOR_H
+
+#include "log.h"
+#include "analyzer.h"
+#include "text_field.h"
+
+Logger monitor_logger("monitor");
+
+struct MonitorReading {
+    uint32_t fq;
+    Complex uncal_z;
+    Complex gamma;
+    Complex z;
+    float swr;
+    float return_loss;
+};
+
+// Measures a single frequency over and over, as fast as the Zero II allows.
+// The calibration at that frequency is looked up once (and again only if
+// the analyzer's calibration or z0 changes), and nothing is allocated per
+// reading.
+class Monitor {
+    public:
+        Monitor(Analyzer* analyzer) {
+            analyzer_ = analyzer;
+            measuring_ = false;
+            readings_ = 0;
+        }
+
+        void initialize(uint32_t fq) {
+            finish();
+            reading_.fq = fq;
+            lookup_calibration();
+            measuring_ = true;
+            monitor_logger.info(String("monitoring fq ")+fq);
+        }
+
+        // takes one reading, blocking until the Zero II has it. returns
+        // true when reading() has a new reading
+        bool poll() {
+            if(!measuring_) {
+                return false;
+            }
+            reading_.uncal_z = analyzer_->uncalibrated_measure(reading_.fq);
+
+            if(analyzer_->generation_ != analyzer_generation_) {
+                lookup_calibration();
+            }
+            reading_.gamma = cal_.calibrate(compute_gamma(reading_.uncal_z, analyzer_->z0_));
+            reading_.z = compute_z(reading_.gamma, analyzer_->z0_);
+            reading_.swr = compute_swr(reading_.gamma);
+            reading_.return_loss = compute_return_loss(reading_.gamma);
+            readings_++;
+            return true;
+        }
+
+        void finish() {
+            measuring_ = false;
+        }
+
+        const MonitorReading& reading() const {
+            return reading_;
+        }
+
+        uint32_t readings_;
+
+    private:
+        Analyzer* analyzer_;
+        MonitorReading reading_;
+        CalibrationPoint cal_;
+        uint32_t analyzer_generation_;
+        bool measuring_;
+
+        void lookup_calibration() {
+            CalibrationPoint scratch;
+            cal_ = *analyzer_->calibration_at(reading_.fq, &scratch);
+            analyzer_generation_ = analyzer_->generation_;
+        }
+};
+
+#define MONITOR_FIELDS 5
+#define MONITOR_FIELD_WIDTH 9
+#define MONITOR_TEXT_SIZE 3
+#define MONITOR_LABEL_WIDTH 4
+#define MONITOR_TOP (8*TITLE_TEXT_SIZE*2)
+
+// strip chart of recent SWR readings along the bottom of the screen
+#define MONITOR_HISTORY 240
+#define MONITOR_CHART_STEP 2
+#define MONITOR_CHART_MAX_SWR 5
+
+const char* monitor_labels[MONITOR_FIELDS] = { "R", "X", "|Z|", "SWR", "RL" };
+
+// Draws monitor readings, only touching characters that changed since the
+// last reading, plus a strip chart that overwrites itself like a scope
+// trace instead of scrolling.
+class MonitorScreen {
+    public:
+        void initialize() {
+            tft.fillRect(0, MONITOR_TOP, tft.width(), tft.height()-MONITOR_TOP, BLACK);
+            tft.setTextSize(MONITOR_TEXT_SIZE);
+            tft.setTextColor(GRAY);
+            for (size_t f = 0; f < MONITOR_FIELDS; f++) {
+                tft.setCursor(0, field_y(f));
+                tft.print(monitor_labels[f]);
+                fields_[f].initialize(MONITOR_LABEL_WIDTH*6*MONITOR_TEXT_SIZE, field_y(f), MONITOR_TEXT_SIZE, MONITOR_FIELD_WIDTH);
+            }
+            tft.setTextColor(WHITE);
+
+            chart_top_ = field_y(MONITOR_FIELDS) + 8;
+            chart_height_ = tft.height() - chart_top_ - 1;
+            chart_width_ = min((int16_t)(MONITOR_HISTORY*MONITOR_CHART_STEP), tft.width());
+            history_idx_ = 0;
+            tft.drawFastHLine(0, chart_top_-1, chart_width_, GRAY);
+            draw_chart_guides(0, chart_width_);
+        }
+
+        void draw_reading(const MonitorReading &r) {
+            char buf[32];
+            draw_field(0, dtostrf(r.z.real(), MONITOR_FIELD_WIDTH, 1, buf));
+            draw_field(1, dtostrf(r.z.imag(), MONITOR_FIELD_WIDTH, 1, buf));
+            draw_field(2, dtostrf(r.z.modulus(), MONITOR_FIELD_WIDTH, 1, buf));
+            draw_field(3, dtostrf(r.swr, MONITOR_FIELD_WIDTH, 2, buf));
+            draw_field(4, dtostrf(r.return_loss, MONITOR_FIELD_WIDTH, 1, buf));
+            add_to_chart(r.swr);
+        }
+
+    private:
+        TextField fields_[MONITOR_FIELDS];
+        int16_t history_y_[MONITOR_HISTORY];
+        size_t history_idx_;
+
+        int16_t chart_top_;
+        int16_t chart_height_;
+        int16_t chart_width_;
+
+        int16_t field_y(size_t f) {
+            return MONITOR_TOP + f*8*MONITOR_TEXT_SIZE;
+        }
+
+        void draw_field(size_t f, char* text) {
+            // too wide to fit (e.g. a huge |Z|), show that rather than a
+            // truncated number
+            if (strlen(text) > MONITOR_FIELD_WIDTH) {
+                memset(text, '*', MONITOR_FIELD_WIDTH);
+                text[MONITOR_FIELD_WIDTH] = '\0';
+            }
+            fields_[f].draw(text);
+        }
+
+        int16_t swr_to_y(float swr) {
+            float clamped = constrain(swr, 1.0f, (float)MONITOR_CHART_MAX_SWR);
+            if (isnan(swr)) {
+                clamped = MONITOR_CHART_MAX_SWR;
+            }
+            return chart_top_ + chart_height_ - 1 - (int16_t)((clamped - 1) / (MONITOR_CHART_MAX_SWR - 1) * (chart_height_ - 1));
+        }
+
+        void draw_chart_guides(int16_t x, int16_t w) {
+            tft.drawFastHLine(x, swr_to_y(3.0), w, RED);
+            tft.drawFastHLine(x, swr_to_y(1.5), w, MAGENTA);
+        }
+
+        void add_to_chart(float swr) {
+            int16_t x = history_idx_*MONITOR_CHART_STEP;
+            int16_t y = swr_to_y(swr);
+
+            // erase a little ahead of the new sample so the write position
+            // is visible, then put back the guide lines we just erased
+            int16_t w = min((int16_t)(2*MONITOR_CHART_STEP), (int16_t)(chart_width_ - x));
+            tft.fillRect(x, chart_top_, w, chart_height_, BLACK);
+            draw_chart_guides(x, w);
+
+            if (history_idx_ > 0) {
+                tft.drawLine(x-MONITOR_CHART_STEP, history_y_[history_idx_-1], x, y, YELLOW);
+            } else {
+                tft.drawPixel(x, y, YELLOW);
+            }
+            history_y_[history_idx_] = y;
+            history_idx_ = (history_idx_ + 1) % MONITOR_HISTORY;
+            if ((history_idx_+1)*MONITOR_CHART_STEP > chart_width_) {
+                history_idx_ = 0;
+            }
+        }
+};
+
+#endif //_MONITOR_H
@@ -3,35 +3,42 @@
 
 #include <SdFat.h>
 #include <Complex.h>
-#include <JsonListener.h>
-#include <JsonStreamingParser.h>
 
 #include "log.h"
 #include "analyzer.h"
+#include "sweep_buffer.h"
+#include "bytes.h"
+#include "json_tokenizer.h"
+#include "file_stream.h"
+#include "manifest.h"
 
 Logger persistence_logger("persistence");
 
 // Tools for managing settings and results persistence
 
-enum SettingsListenerState { SETTINGS_START, SETTINGS_Z0, SETTINGS_CAL, SETTINGS_CAL_POINT, SETTINGS_CAL_FQ, SETTINGS_CAL_S, SETTINGS_CAL_S_R, SETTINGS_CAL_S_I, SETTINGS_CAL_O, SETTINGS_CAL_O_R, SETTINGS_CAL_O_I, SETTINGS_CAL_L, SETTINGS_CAL_L_R, SETTINGS_CAL_L_I };
+enum SettingsListenerState { SETTINGS_START, SETTINGS_Z0, SETTINGS_CAL, SETTINGS_CAL_POINT, SETTINGS_CAL_FQ, SETTINGS_CAL_S, SETTINGS_CAL_S_R, SETTINGS_CAL_S_I, SETTINGS_CAL_O, SETTINGS_CAL_O_R, SETTINGS_CAL_O_I, SETTINGS_CAL_L, SETTINGS_CAL_L_R, SETTINGS_CAL_L_I, SETTINGS_INTERP, SETTINGS_AVG_SAMPLES, SETTINGS_AVG_TOL };
 
-class SettingsJsonListener : public JsonListener {
+// Calibration points are decoded straight into calibration_results, which
+// has room for max_steps. touched_ says if any of it has been overwritten,
+// the scalar settings are only kept here until the caller commits them.
+class SettingsJsonListener {
 public:
-    SettingsJsonListener(size_t max_steps) {
+    SettingsJsonListener(CalibrationPoint* calibration_results, size_t max_steps) {
         max_steps_ = max_steps;
-        calibration_results_ = new CalibrationPoint[max_steps];
-    }
-
-    ~SettingsJsonListener() {
-        delete [] calibration_results_;
+        calibration_results_ = calibration_results;
     }
 
     void initialize() {
         state_ = SETTINGS_START;
         has_error_ = false;
+        touched_ = false;
         calibration_len_ = 0;
         saw_z0_ = false;
         saw_end_ = false;
+        // older settings files don't have these
+        interpolation_ = CAL_INTERP_LINEAR;
+        average_samples_ = 1;
+        average_tolerance_ = AVERAGE_DEFAULT_TOLERANCE;
     }
 
     void complete() {
@@ -41,37 +48,43 @@ public:
         }
     }
 
-    void key(String k) {
+    void key(const JsonValue &k) {
         if (has_error_) {
             return;
         }
         switch(state_) {
             case SETTINGS_START:
-                if (k == "z0") {
+                if (k.equals("z0")) {
                     state_ = SETTINGS_Z0;
-                } else if(k == "calibration") {
+                } else if(k.equals("calibration")) {
                     state_ = SETTINGS_CAL;
+                } else if(k.equals("interpolation")) {
+                    state_ = SETTINGS_INTERP;
+                } else if(k.equals("average_samples")) {
+                    state_ = SETTINGS_AVG_SAMPLES;
+                } else if(k.equals("average_tolerance")) {
+                    state_ = SETTINGS_AVG_TOL;
                 }
                 break;
             case SETTINGS_CAL_POINT:
-                if (k == "fq") {
+                if (k.equals("fq")) {
                     state_ = SETTINGS_CAL_FQ;
-                } else if (k == "cal_short") {
+                } else if (k.equals("cal_short")) {
                     state_ = SETTINGS_CAL_S;
-                } else if (k == "cal_open") {
+                } else if (k.equals("cal_open")) {
                     state_ = SETTINGS_CAL_O;
-                } else if (k == "cal_load") {
+                } else if (k.equals("cal_load")) {
                     state_ = SETTINGS_CAL_L;
                 }
                 break;
             default:
                 // only allow keys in the root or inside a calibration point
                 has_error_ = true;
-                persistence_logger.warn(String("key \"")+k+"\" found in state "+state_);
+                persistence_logger.warn(String("key \"")+k.text_+"\" found in state "+state_);
         }
     }
 
-    void value(String v) {
+    void value(const JsonValue &v) {
         if (has_error_) {
             return;
         }
@@ -80,29 +93,42 @@ public:
             case SETTINGS_CAL_POINT:
                 break;
             case SETTINGS_Z0:
-                z0_ = atof(v.c_str());
+                z0_ = v.to_float();
                 state_ = SETTINGS_START;
                 saw_z0_ = true;
                 break;
+            case SETTINGS_INTERP:
+                interpolation_ = v.to_long() == CAL_INTERP_CUBIC ? CAL_INTERP_CUBIC : CAL_INTERP_LINEAR;
+                state_ = SETTINGS_START;
+                break;
+            case SETTINGS_AVG_SAMPLES:
+                average_samples_ = constrain(v.to_long(), 1, AVERAGE_MAX_SAMPLES);
+                state_ = SETTINGS_START;
+                break;
+            case SETTINGS_AVG_TOL:
+                average_tolerance_ = v.to_float();
+                state_ = SETTINGS_START;
+                break;
             case SETTINGS_CAL_FQ:
-                calibration_results_[calibration_len_].fq = atoi(v.c_str());
+                calibration_results_[calibration_len_].fq = v.to_long();
+                touched_ = true;
                 state_ = SETTINGS_CAL_POINT;
                 saw_fq_ = true;
                 break;
             case SETTINGS_CAL_S_R:
             case SETTINGS_CAL_O_R:
             case SETTINGS_CAL_L_R:
-                cal_val_.setReal(atof(v.c_str()));
+                cal_val_.setReal(v.to_float());
                 state_ += 1;
                 break;
             case SETTINGS_CAL_S_I:
             case SETTINGS_CAL_O_I:
             case SETTINGS_CAL_L_I:
-                cal_val_.setImag(atof(v.c_str()));
+                cal_val_.setImag(v.to_float());
                 break;
             default:
                 has_error_ = true;
-                persistence_logger.warn(String("value \"")+v+"\" found in state "+state_);
+                persistence_logger.warn(String("value \"")+v.text_+"\" found in state "+state_);
         }
     }
 
@@ -137,16 +163,19 @@ public:
                 break;
             case SETTINGS_CAL_S_I:
                 calibration_results_[calibration_len_].cal_short = cal_val_;
+                touched_ = true;
                 saw_cal_short_ = true;
                 state_ = SETTINGS_CAL_POINT;
                 break;
             case SETTINGS_CAL_O_I:
                 calibration_results_[calibration_len_].cal_open = cal_val_;
+                touched_ = true;
                 saw_cal_open_ = true;
                 state_ = SETTINGS_CAL_POINT;
                 break;
             case SETTINGS_CAL_L_I:
                 calibration_results_[calibration_len_].cal_load = cal_val_;
+                touched_ = true;
                 saw_cal_load_ = true;
                 state_ = SETTINGS_CAL_POINT;
                 break;
@@ -223,11 +252,12 @@ public:
         saw_end_ = true;
     }
 
-    void whitespace(char c) {
-    }
-
     bool has_error_;
+    bool touched_;
     float z0_;
+    uint8_t interpolation_;
+    uint8_t average_samples_;
+    float average_tolerance_;
     size_t calibration_len_;
     CalibrationPoint* calibration_results_;
 private:
@@ -243,23 +273,22 @@ private:
     bool saw_end_;
 };
 
-enum ResultsListenerState { RESULTS_START, RESULTS_POINT, RESULTS_FQ, RESULTS_Z, RESULTS_Z_R, RESULTS_Z_I };
+enum ResultsListenerState { RESULTS_START, RESULTS_POINT, RESULTS_FQ, RESULTS_Z, RESULTS_Z_R, RESULTS_Z_I, RESULTS_SAMPLES, RESULTS_SEGMENT };
 
-class ResultsJsonListener : public JsonListener {
+// Points are decoded into the caller's results, each one stored once
+// it's complete. results' length is left alone, touched_ says if any point
+// has been overwritten.
+class ResultsJsonListener {
 public:
-    ResultsJsonListener(size_t max_steps) {
-        max_steps_ = max_steps;
-        results_ = new AnalysisPoint[max_steps];
-    }
-
-    ~ResultsJsonListener() {
-        delete [] results_;
+    ResultsJsonListener(SweepBuffer* results) {
+        results_ = results;
     }
 
     void initialize() {
         results_len_ = 0;
         state_ = RESULTS_START;
         has_error_ = false;
+        touched_ = false;
         saw_end_ = false;
     }
 
@@ -270,46 +299,58 @@ public:
         }
     }
 
-    void key(String k) {
+    void key(const JsonValue &k) {
         if(has_error_) {
             return;
         }
         switch(state_) {
             case RESULTS_POINT:
-                if (k == "fq") {
+                if (k.equals("fq")) {
                     state_ = RESULTS_FQ;
-                } else if (k =="uncal_z") {
+                } else if (k.equals("uncal_z")) {
                     state_ = RESULTS_Z;
+                } else if (k.equals("samples")) {
+                    state_ = RESULTS_SAMPLES;
+                } else if (k.equals("segment")) {
+                    state_ = RESULTS_SEGMENT;
                 }
                 break;
             default:
                 has_error_ = true;
-                persistence_logger.warn(String("key \"")+k+"\" found in state "+state_);
+                persistence_logger.warn(String("key \"")+k.text_+"\" found in state "+state_);
         }
     }
 
-    void value(String v) {
+    void value(const JsonValue &v) {
         if(has_error_) {
             return;
         }
         switch(state_) {
             case RESULTS_FQ:
-                results_[results_len_].fq = atoi(v.c_str());
+                fq_ = v.to_long();
                 state_ = RESULTS_POINT;
                 saw_fq_ = true;
                 break;
             case RESULTS_Z_R:
-                results_[results_len_].uncal_z.setReal(atof(v.c_str()));
+                uncal_z_.setReal(v.to_float());
                 state_ = RESULTS_Z_I;
                 break;
             case RESULTS_Z_I:
-                results_[results_len_].uncal_z.setImag(atof(v.c_str()));
+                uncal_z_.setImag(v.to_float());
+                break;
+            case RESULTS_SAMPLES:
+                samples_ = v.to_long();
+                state_ = RESULTS_POINT;
+                break;
+            case RESULTS_SEGMENT:
+                segment_ = v.to_long();
+                state_ = RESULTS_POINT;
                 break;
             case RESULTS_POINT:
                 break;
             default:
                 has_error_ = true;
-                persistence_logger.warn(String("value \"")+v+"\" found in state "+state_);
+                persistence_logger.warn(String("value \"")+v.text_+"\" found in state "+state_);
         }
     }
 
@@ -352,13 +393,17 @@ public:
         }
         switch(state_) {
             case RESULTS_START:
-                if (results_len_ == max_steps_) {
+                if (results_len_ == results_->max_len_) {
                     has_error_ = true;
                     persistence_logger.warn("too many result points");
                 } else {
                     state_ = RESULTS_POINT;
                     saw_fq_ = false;
                     saw_z_ = false;
+                    // results saved without averaging or segments don't
+                    // have these
+                    samples_ = 1;
+                    segment_ = 0;
                 }
                 break;
             case RESULTS_POINT:
@@ -379,6 +424,8 @@ public:
                     has_error_ = true;
                     persistence_logger.warn("didn't see all required fields in result point");
                 } else {
+                    results_->set(results_len_, fq_, uncal_z_, samples_, segment_);
+                    touched_ = true;
                     results_len_++;
                 }
                 state_ = RESULTS_START;
@@ -402,25 +449,94 @@ public:
         }
     }
 
-    void whitespace(char c) {
-    }
-
     size_t results_len_;
-    AnalysisPoint* results_;
 
     bool has_error_;
+    bool touched_;
 private:
+    SweepBuffer* results_;
     uint8_t state_;
-    size_t max_steps_;
+
+    // the point being parsed
+    uint32_t fq_;
+    Complex uncal_z_;
+    uint8_t samples_;
+    uint8_t segment_;
+
     bool saw_fq_;
     bool saw_z_;
     bool saw_end_;
 };
 
+// Just enough of a settings or results file for its manifest entry: every
+// point has an "fq", so those are counted and give the range.
+class SummaryJsonListener {
+public:
+    SummaryJsonListener(ManifestEntry* summary) {
+        summary_ = summary;
+        fq_next_ = false;
+    }
+
+    void key(const JsonValue &k) {
+        fq_next_ = k.equals("fq");
+    }
+
+    void value(const JsonValue &v) {
+        if(fq_next_ && summary_->points < 0xFFFF) {
+            uint32_t fq = v.to_long();
+            if(summary_->points == 0) {
+                summary_->start_fq = fq;
+            }
+            summary_->end_fq = fq;
+            summary_->points++;
+        }
+        fq_next_ = false;
+    }
+
+    void startDocument() {}
+    void endDocument() {}
+    void startObject() {}
+    void endObject() {}
+    void startArray() {
+        fq_next_ = false;
+    }
+    void endArray() {}
+
+private:
+    ManifestEntry* summary_;
+    bool fq_next_;
+};
+
 #define DEFAULT_ANALYZER_PERSISTENCE_NAME "zeroii-analyzer"
 #define SETTINGS_PREFIX "settings_"
 #define RESULTS_PREFIX "results_"
 
+// Files ending in PERSISTENCE_BINARY_EXT use a binary format, anything else
+// is JSON. Binary files are:
+//  a header of PERSISTENCE_HEADER_SIZE bytes:
+//   magic (4 bytes), version (u16), record count (u16), then for
+//   results: z0 (f32), first fq (u32), last fq (u32), segments (u8),
+//    min SWR (f32 at 24), fq of the min SWR (u32)
+//   settings: z0 (f32), interpolation (u8), average samples (u8),
+//    average tolerance (f32)
+//   version 1 headers stop at 24 bytes, before the min SWR
+//  fixed size records:
+//   results: fq (u32), uncal z (2 f32) as AnalysisPoint::to_bytes,
+//    samples (u8), segment (u8)
+//   settings: fq (u32), short, open and load (2 f32 each)
+//  the CRC-32 of everything before it (u32)
+// numbers are little endian like the RA4M1, unused bytes are zero
+#define PERSISTENCE_BINARY_EXT ".bin"
+#define PERSISTENCE_VERSION 2
+#define RESULTS_MAGIC "ZIIR"
+#define SETTINGS_MAGIC "ZIIS"
+#define PERSISTENCE_HEADER_SIZE 32
+#define PERSISTENCE_V1_HEADER_SIZE 24
+#define RESULTS_RECORD_SIZE 16
+#define SETTINGS_RECORD_SIZE 28
+// records packed or unpacked at a time
+#define PERSISTENCE_CHUNK_RECORDS 8
+
 class AnalyzerPersistence {
     public:
     // save named settings
@@ -431,76 +547,61 @@ class AnalyzerPersistence {
             return false;
         }
 
-        char buf[32];
-        entry.write("{\"z0\":");
-        entry.write(dtostrf(analyzer->z0_, 1, 6, buf));
-
-        entry.write(",\"calibration\":[");
-        bool is_first = true;
-        for(size_t i; i<analyzer->calibration_len_; i++) {
-            if(!is_first) {
-                entry.write(",");
-            } else {
-                is_first = false;
-            }
-            entry.write("{\"fq\":");
-            entry.write(itoa(analyzer->calibration_results_[i].fq, buf, 10));
-
-            entry.write(",\"cal_short\":[");
-            entry.write(dtostrf(analyzer->calibration_results_[i].cal_short.real(), 1, 6, buf));
-            entry.write(",");
-            entry.write(dtostrf(analyzer->calibration_results_[i].cal_short.imag(), 1, 6, buf));
-            entry.write("]");
-
-            entry.write(",\"cal_open\":[");
-            entry.write(dtostrf(analyzer->calibration_results_[i].cal_open.real(), 1, 6, buf));
-            entry.write(",");
-            entry.write(dtostrf(analyzer->calibration_results_[i].cal_open.imag(), 1, 6, buf));
-            entry.write("]");
-
-            entry.write(",\"cal_load\":[");
-            entry.write(dtostrf(analyzer->calibration_results_[i].cal_load.real(), 1, 6, buf));
-            entry.write(",");
-            entry.write(dtostrf(analyzer->calibration_results_[i].cal_load.imag(), 1, 6, buf));
-            entry.write("]");
-
-            entry.write("}");
-        }
-        entry.write("]");
-        entry.write("}");
-
+        bool ok = is_binary(name) ? save_settings_binary(&entry, analyzer) : save_settings_json(&entry, analyzer);
+        ManifestEntry summary;
+        summarize_settings(name, analyzer, &summary);
+        ok = ok && file_timestamp(&entry, &summary);
         entry.close();
+        if(!ok) {
+            persistence_logger.error(String("failed writing settings to ")+name);
+            // whatever is left of the file needs a fresh summary
+            settings_manifest_.invalidate();
+            return false;
+        }
+        settings_manifest_.update(summary);
         persistence_logger.info(String("saved settings to ")+name);
         return true;
     }
 
     bool load_settings(FsFile* entry, Analyzer* analyzer, size_t max_cal_len) {
-        JsonStreamingParser parser;
-        SettingsJsonListener listener(max_cal_len);
+        if(is_binary(entry)) {
+            return load_settings_binary(entry, analyzer, max_cal_len);
+        }
+
+        JsonTokenizer tokenizer;
+        SettingsJsonListener listener(analyzer->calibration_results_, max_cal_len);
         listener.initialize();
-        parser.setListener(&listener);
 
+        FileReader in(entry);
         int c;
-        while((c = entry->read()) >= 0) {
-            parser.parse(c);
+        while((c = in.read()) >= 0) {
+            tokenizer.parse(c, &listener);
         }
 
-        if(entry->available() > 0) {
-            persistence_logger.error(String("failed to read settings file error ")+entry->getError());
-            return false;
-        }
         listener.complete();
 
-        if (listener.has_error_) {
+        if(in.failed() || listener.has_error_ || tokenizer.has_error_) {
+            if(in.failed()) {
+                persistence_logger.error(String("failed to read settings file error ")+entry->getError());
+            }
             persistence_logger.error("failed to load settings");
+            if(listener.touched_) {
+                // part of the old calibration was overwritten, don't use
+                // what's left of it
+                persistence_logger.warn(F("dropping partly loaded calibration"));
+                analyzer->calibration_len_ = 0;
+                analyzer->calibration_changed();
+            }
             return false;
         }
 
         analyzer->z0_ = listener.z0_;
-        for(size_t i; i<listener.calibration_len_; i++) {
-            analyzer->calibration_results_[i] = listener.calibration_results_[i];
-        }
+        analyzer->interpolation_ = listener.interpolation_;
+        analyzer->average_samples_ = listener.average_samples_;
+        analyzer->average_tolerance_ = listener.average_tolerance_;
         analyzer->calibration_len_ = listener.calibration_len_;
+        analyzer->solve_calibration();
+        analyzer->calibration_changed();
 
         persistence_logger.info("loaded settings");
         return true;
@@ -517,29 +618,19 @@ class AnalyzerPersistence {
 
     // save settings to automatically named file
     bool save_settings(const Analyzer* analyzer) {
-        FsFile entry;
-        char filename[128];
-        if(find_latest_file(&settings_dir_, &entry, SETTINGS_PREFIX)) {
-            size_t filename_len = entry.getName(filename, sizeof(filename));;
-            entry.close();
-            persistence_logger.info(String("latest file is ")+filename);
-            persistence_logger.info(String("suffix is \"")+(filename+sizeof(SETTINGS_PREFIX))+("\""));
-            int file_number = str2int(filename+sizeof(SETTINGS_PREFIX)-1, filename_len-sizeof(SETTINGS_PREFIX)+1);
-            persistence_logger.info(String("number is ")+file_number);
-            (String(SETTINGS_PREFIX)+(file_number+1)+".json").toCharArray(filename, sizeof(filename));
-            persistence_logger.info(String("saving settings to additional settings file ")+filename);
-            return save_settings(filename, analyzer);
-        } else {
-            (String(SETTINGS_PREFIX)+"0.json").toCharArray(filename, sizeof(filename));
-            persistence_logger.info(String("saving settings to first settings file ")+filename);
-            return save_settings(filename, analyzer);
+        char filename[MANIFEST_NAME_LEN];
+        if(!settings_manifest_.refresh()) {
+            return false;
         }
+        settings_manifest_.next_name(filename, sizeof(filename));
+        persistence_logger.info(String("saving settings to ")+filename);
+        return save_settings(filename, analyzer);
     }
 
     // load most recent settings
     bool load_settings(Analyzer* analyzer, size_t max_cal_len) {
         FsFile entry;
-        if(find_latest_file(&settings_dir_, &entry, SETTINGS_PREFIX)) {
+        if(open_latest(&settings_manifest_, &settings_dir_, &entry)) {
             return load_settings(&entry, analyzer, max_cal_len) && entry.close();
         } else {
             persistence_logger.warn("no settings found");
@@ -548,107 +639,103 @@ class AnalyzerPersistence {
     }
 
     // save named results
-    bool save_results(const char* name, const AnalysisPoint* results, const size_t results_len) {
+    // analyzer is for the file's summary, z0 and min SWR are only recorded
+    // in binary files
+    bool save_results(const char* name, const SweepBuffer* results, const Analyzer* analyzer) {
         FsFile entry;
         if(!entry.open(&results_dir_, name, O_WRONLY | O_CREAT | O_TRUNC)) {
             persistence_logger.error(String("could not open ") + name);
             return false;
         }
 
-        entry.write("[");
-        bool is_first = true;
-        char buf[32];
-        for(size_t i; i<results_len; i++) {
-            if(!is_first) {
-                entry.write(",");
-            } else {
-                is_first = false;
-            }
-            entry.write("{\"fq\":");
-            entry.write(itoa(results[i].fq, buf, 10));
-
-            entry.write(",\"uncal_z\":[");
-            entry.write(dtostrf(results[i].uncal_z.real(), 1, 6, buf));
-            entry.write(",");
-            entry.write(dtostrf(results[i].uncal_z.imag(), 1, 6, buf));
-            entry.write("]}");
-        }
-        entry.write("]");
-
+        ManifestEntry summary;
+        summarize_results(name, results, analyzer, &summary);
+        bool ok = is_binary(name) ? save_results_binary(&entry, results, analyzer->z0_, summary) : save_results_json(&entry, results);
+        ok = ok && file_timestamp(&entry, &summary);
         entry.close();
+        if(!ok) {
+            persistence_logger.error(String("failed writing results to ")+name);
+            results_manifest_.invalidate();
+            return false;
+        }
+        results_manifest_.update(summary);
         return true;
     }
 
-    bool load_results(FsFile* entry, AnalysisPoint* results, size_t *results_len, size_t max_len) {
-        JsonStreamingParser parser;
-        ResultsJsonListener listener(max_len);
+    bool load_results(FsFile* entry, SweepBuffer* results) {
+        if(is_binary(entry)) {
+            return load_results_binary(entry, results);
+        }
+
+        JsonTokenizer tokenizer;
+        ResultsJsonListener listener(results);
         listener.initialize();
-        parser.setListener(&listener);
 
+        FileReader in(entry);
         int c;
-        while((c = entry->read()) >= 0) {
-            parser.parse(c);
+        while((c = in.read()) >= 0) {
+            tokenizer.parse(c, &listener);
         }
 
-        if(entry->available() > 0) {
-            persistence_logger.error(String("failed to read results file error ")+entry->getError());
-            return false;
-        }
         listener.complete();
 
-        if(listener.has_error_) {
+        if(in.failed() || listener.has_error_ || tokenizer.has_error_) {
+            if(in.failed()) {
+                persistence_logger.error(String("failed to read results file error ")+entry->getError());
+            }
             persistence_logger.error("failed to load results");
+            if(listener.touched_) {
+                // part of the old results were overwritten
+                results->len_ = 0;
+            }
             return false;
         }
 
-        for(size_t i=0; i<listener.results_len_; i++) {
-            results[i] = listener.results_[i];
-        }
-        *results_len = listener.results_len_;
+        results->len_ = listener.results_len_;
         persistence_logger.info(String("loaded ")+listener.results_len_+" results");
         return true;
     }
 
     // load named results
-    bool load_results(const char* name, AnalysisPoint* results, size_t *results_len, const size_t max_len) {
+    bool load_results(const char* name, SweepBuffer* results) {
         FsFile entry;
         if(!entry.open(&results_dir_, name, O_RDONLY)) {
             persistence_logger.error(String("could not open results file ") + name);
             return false;
         }
         persistence_logger.info(String("loaded results from ") + name);
-        return load_results(&entry, results, results_len, max_len) && entry.close();
+        return load_results(&entry, results) && entry.close();
     }
 
     // save automatically named results file
-    bool save_results(const AnalysisPoint* results, const size_t results_len) {
-        FsFile entry;
-        char filename[128];
-        if(find_latest_file(&results_dir_, &entry, RESULTS_PREFIX)) {
-            size_t filename_len = entry.getName(filename, sizeof(filename));
-            entry.close();
-            int file_number = str2int(filename+sizeof(RESULTS_PREFIX)-1, filename_len-sizeof(RESULTS_PREFIX)+1);
-            (String(RESULTS_PREFIX)+(file_number+1)+".json").toCharArray(filename, sizeof(filename));
-            persistence_logger.info(String("saving results to additional results file ")+filename);
-            return save_results(filename, results, results_len);
-        } else {
-            (String(RESULTS_PREFIX)+"0.json").toCharArray(filename, sizeof(filename));
-            persistence_logger.info(String("saving results to first results file ")+filename);
-            return save_results(filename, results, results_len);
+    bool save_results(const SweepBuffer* results, const Analyzer* analyzer) {
+        char filename[MANIFEST_NAME_LEN];
+        if(!results_manifest_.refresh()) {
+            return false;
         }
+        results_manifest_.next_name(filename, sizeof(filename));
+        persistence_logger.info(String("saving results to ")+filename);
+        return save_results(filename, results, analyzer);
     }
 
     // load most recent results
-    bool load_results(AnalysisPoint* results, size_t *results_len, const size_t max_len) {
+    bool load_results(SweepBuffer* results) {
         FsFile entry;
-        if(find_latest_file(&results_dir_, &entry, RESULTS_PREFIX)) {
-            return load_results(&entry, results, results_len, max_len) && entry.close();
+        if(open_latest(&results_manifest_, &results_dir_, &entry)) {
+            return load_results(&entry, results) && entry.close();
         } else {
             persistence_logger.warn("no results found");
             return false;
         }
     }
 
+    // files were changed outside of AnalyzerPersistence, e.g. from the
+    // shell, rebuild the manifests before using them again
+    void invalidate_manifests() {
+        settings_manifest_.invalidate();
+        results_manifest_.invalidate();
+    }
+
     bool begin(const char* directory_name=DEFAULT_ANALYZER_PERSISTENCE_NAME) {
         // check for directory structure
         FsFile root;
@@ -701,63 +788,471 @@ class AnalyzerPersistence {
             persistence_logger.error("results dir is not open");
         }
 
+        settings_manifest_.initialize(&settings_dir_, SETTINGS_PREFIX, PERSISTENCE_BINARY_EXT, &summarize_settings_file);
+        results_manifest_.initialize(&results_dir_, RESULTS_PREFIX, PERSISTENCE_BINARY_EXT, &summarize_results_file);
+        settings_manifest_.refresh();
+        results_manifest_.refresh();
+
         return true;
     }
 
     FsFile settings_dir_;
     FsFile results_dir_;
+    DirectoryManifest settings_manifest_;
+    DirectoryManifest results_manifest_;
 
     private:
-    int str2int(const char* str, int len)
-    {
-        int i;
-        int ret = 0;
-        for(i = 0; i < len; ++i)
-        {
-            if(str[i] < '0' || str [i] > '9') {
-                return ret;
+    bool save_settings_json(FsFile* entry, const Analyzer* analyzer) {
+        FileWriter out(entry);
+        char buf[32];
+        out.write("{\"z0\":");
+        out.write(dtostrf(analyzer->z0_, 1, 6, buf));
+
+        out.write(",\"interpolation\":");
+        out.write(itoa(analyzer->interpolation_, buf, 10));
+
+        out.write(",\"average_samples\":");
+        out.write(itoa(analyzer->average_samples_, buf, 10));
+        out.write(",\"average_tolerance\":");
+        out.write(dtostrf(analyzer->average_tolerance_, 1, 6, buf));
+
+        out.write(",\"calibration\":[");
+        bool is_first = true;
+        for(size_t i=0; i<analyzer->calibration_len_; i++) {
+            if(!is_first) {
+                out.write(",");
+            } else {
+                is_first = false;
+            }
+            out.write("{\"fq\":");
+            out.write(itoa(analyzer->calibration_results_[i].fq, buf, 10));
+
+            out.write(",\"cal_short\":[");
+            out.write(dtostrf(analyzer->calibration_results_[i].cal_short.real(), 1, 6, buf));
+            out.write(",");
+            out.write(dtostrf(analyzer->calibration_results_[i].cal_short.imag(), 1, 6, buf));
+            out.write("]");
+
+            out.write(",\"cal_open\":[");
+            out.write(dtostrf(analyzer->calibration_results_[i].cal_open.real(), 1, 6, buf));
+            out.write(",");
+            out.write(dtostrf(analyzer->calibration_results_[i].cal_open.imag(), 1, 6, buf));
+            out.write("]");
+
+            out.write(",\"cal_load\":[");
+            out.write(dtostrf(analyzer->calibration_results_[i].cal_load.real(), 1, 6, buf));
+            out.write(",");
+            out.write(dtostrf(analyzer->calibration_results_[i].cal_load.imag(), 1, 6, buf));
+            out.write("]");
+
+            out.write("}");
+        }
+        out.write("]");
+        out.write("}");
+
+        return out.flush();
+    }
+
+
+    bool save_results_json(FsFile* entry, const SweepBuffer* results) {
+        FileWriter out(entry);
+        out.write("[");
+        bool is_first = true;
+        char buf[32];
+        for(size_t i=0; i<results->len_; i++) {
+            if(!is_first) {
+                out.write(",");
             } else {
-                ret = ret * 10 + (str[i] - '0');
+                is_first = false;
+            }
+            out.write("{\"fq\":");
+            out.write(itoa(results->fq_[i], buf, 10));
+
+            out.write(",\"uncal_z\":[");
+            out.write(dtostrf(results->re_[i], 1, 6, buf));
+            out.write(",");
+            out.write(dtostrf(results->im_[i], 1, 6, buf));
+            out.write("]");
+
+            if(results->samples_) {
+                out.write(",\"samples\":");
+                out.write(itoa(results->samples_[i], buf, 10));
+            }
+            // only multi segment sweeps need this
+            if(results->segment(i) != 0) {
+                out.write(",\"segment\":");
+                out.write(itoa(results->segment(i), buf, 10));
+            }
+            out.write("}");
+        }
+        out.write("]");
+
+        return out.flush();
+    }
+
+
+    static bool is_binary(const char* name) {
+        size_t len = strlen(name);
+        size_t ext_len = strlen(PERSISTENCE_BINARY_EXT);
+        return len >= ext_len && strcasecmp(name+len-ext_len, PERSISTENCE_BINARY_EXT) == 0;
+    }
+
+    static bool is_binary(FsFile* entry) {
+        char name[128];
+        entry->getName(name, sizeof(name));
+        return is_binary(name);
+    }
+
+    // header fields shared by results and settings, the rest is zeroed
+    void put_header(uint8_t* header, const char* magic, uint16_t count) {
+        memset(header, 0, PERSISTENCE_HEADER_SIZE);
+        memcpy(header, magic, 4);
+        put_u16(header+4, PERSISTENCE_VERSION);
+        put_u16(header+6, count);
+    }
+
+    bool write_block(FileWriter* out, const uint8_t* data, size_t len, uint32_t* crc) {
+        *crc = crc32_update(*crc, data, len);
+        return out->write(data, len) == len;
+    }
+
+    bool write_crc(FileWriter* out, uint32_t crc) {
+        uint8_t data[sizeof(uint32_t)];
+        put_u32(data, ~crc);
+        out->write(data, sizeof(data));
+        return out->flush();
+    }
+
+    // reads and checks the header, size and CRC of a binary file, leaving
+    // in positioned at the first record so nothing is loaded from a
+    // damaged file. header needs room for PERSISTENCE_HEADER_SIZE bytes,
+    // older versions have less of it filled in.
+    bool check_binary(FsFile* entry, FileReader* in, const char* magic, size_t record_size, size_t max_count, uint8_t* header, uint16_t* count) {
+        if(!in->seek(0) || in->read(header, 8) != 8) {
+            persistence_logger.error(F("binary file too short for a header"));
+            return false;
+        }
+        if(memcmp(header, magic, 4) != 0) {
+            persistence_logger.error(F("binary file has the wrong magic"));
+            return false;
+        }
+        uint16_t version = get_u16(header+4);
+        if(version > PERSISTENCE_VERSION) {
+            persistence_logger.error(String("binary file version ")+version+" is newer than "+PERSISTENCE_VERSION);
+            return false;
+        }
+        size_t header_size = version < 2 ? PERSISTENCE_V1_HEADER_SIZE : PERSISTENCE_HEADER_SIZE;
+        memset(header+8, 0, PERSISTENCE_HEADER_SIZE-8);
+        if(in->read(header+8, header_size-8) != header_size-8) {
+            persistence_logger.error(F("binary file too short for a header"));
+            return false;
+        }
+        *count = get_u16(header+6);
+        if(*count > max_count) {
+            persistence_logger.error(String("binary file has ")+*count+" records, max is "+max_count);
+            return false;
+        }
+        size_t data_size = header_size + *count*record_size;
+        if(entry->size() != data_size + sizeof(uint32_t)) {
+            persistence_logger.error(String("binary file is ")+(uint32_t)entry->size()+" bytes, expected "+(data_size + sizeof(uint32_t)));
+            return false;
+        }
+
+        uint32_t crc = crc32_update(0xFFFFFFFF, header, header_size);
+        uint8_t buf[PERSISTENCE_CHUNK_RECORDS*SETTINGS_RECORD_SIZE];
+        size_t left = data_size - header_size;
+        while(left > 0) {
+            size_t n = min(left, sizeof(buf));
+            if(in->read(buf, n) != n) {
+                persistence_logger.error(String("failed to read binary file error ")+entry->getError());
+                return false;
+            }
+            crc = crc32_update(crc, buf, n);
+            left -= n;
+        }
+        if(in->read(buf, sizeof(uint32_t)) != sizeof(uint32_t) || get_u32(buf) != ~crc) {
+            persistence_logger.error(F("binary file failed its CRC check"));
+            return false;
+        }
+        return in->seek(header_size);
+    }
+
+    bool save_results_binary(FsFile* entry, const SweepBuffer* results, float z0, const ManifestEntry &summary) {
+        FileWriter out(entry);
+        uint8_t buf[PERSISTENCE_CHUNK_RECORDS*RESULTS_RECORD_SIZE];
+        put_header(buf, RESULTS_MAGIC, results->len_);
+        put_f32(buf+8, z0);
+        put_f32(buf+24, summary.min_swr);
+        if(results->len_ > 0) {
+            put_u32(buf+12, summary.start_fq);
+            put_u32(buf+16, summary.end_fq);
+            buf[20] = results->segment(results->len_-1) + 1;
+            put_u32(buf+28, summary.min_swr_fq);
+        }
+        uint32_t crc = 0xFFFFFFFF;
+        if(!write_block(&out, buf, PERSISTENCE_HEADER_SIZE, &crc)) {
+            return false;
+        }
+
+        for(size_t start=0; start<results->len_; start+=PERSISTENCE_CHUNK_RECORDS) {
+            size_t n = min((size_t)PERSISTENCE_CHUNK_RECORDS, results->len_-start);
+            memset(buf, 0, sizeof(buf));
+            for(size_t k=0; k<n; k++) {
+                uint8_t* record = buf + k*RESULTS_RECORD_SIZE;
+                AnalysisPoint::to_bytes((*results)[start+k], record);
+                record[AnalysisPoint::data_size] = results->samples(start+k);
+                record[AnalysisPoint::data_size+1] = results->segment(start+k);
             }
+            if(!write_block(&out, buf, n*RESULTS_RECORD_SIZE, &crc)) {
+                return false;
+            }
+        }
+        return write_crc(&out, crc);
+    }
+
+    bool load_results_binary(FsFile* entry, SweepBuffer* results) {
+        uint8_t buf[PERSISTENCE_CHUNK_RECORDS*RESULTS_RECORD_SIZE];
+        uint16_t count;
+        FileReader in(entry);
+        if(!check_binary(entry, &in, RESULTS_MAGIC, RESULTS_RECORD_SIZE, results->max_len_, buf, &count)) {
+            persistence_logger.error("failed to load results");
+            return false;
         }
-        return ret;
-    }
-
-    bool find_latest_file(FsFile* directory, FsFile* entry, const char* prefix) {
-        size_t prefix_len = strlen(prefix);
-        // iterate through directory
-        char filename[128];
-        char max_filename[128];
-        int max_file_number = -1;
-        directory->rewindDirectory();
-        while(entry->openNext(directory, O_RDONLY)) {
-            // check for an int at the end of each file name after prefix
-            size_t name_len = entry->getName(filename, sizeof(filename));
-            if (strncmp(filename, prefix, min(name_len, prefix_len)) != 0) {
-                entry->close();
-                continue;
+        if(persistence_logger.enabled(LOG_DEBUG)) {
+            persistence_logger.debug(String("results were measured with z0 ")+get_f32(buf+8));
+        }
+
+        for(size_t start=0; start<count; start+=PERSISTENCE_CHUNK_RECORDS) {
+            size_t n = min((size_t)PERSISTENCE_CHUNK_RECORDS, count-start);
+            if(in.read(buf, n*RESULTS_RECORD_SIZE) != n*RESULTS_RECORD_SIZE) {
+                persistence_logger.error(String("failed to read results file error ")+entry->getError());
+                if(start > 0) {
+                    // part of the old results were overwritten
+                    results->len_ = 0;
+                }
+                return false;
             }
+            for(size_t k=0; k<n; k++) {
+                const uint8_t* record = buf + k*RESULTS_RECORD_SIZE;
+                AnalysisPoint p = AnalysisPoint::from_bytes(record);
+                results->set(start+k, p.fq, p.uncal_z, record[AnalysisPoint::data_size], record[AnalysisPoint::data_size+1]);
+            }
+        }
+        results->len_ = count;
+        persistence_logger.info(String("loaded ")+count+" results");
+        return true;
+    }
+
+    bool save_settings_binary(FsFile* entry, const Analyzer* analyzer) {
+        FileWriter out(entry);
+        uint8_t buf[PERSISTENCE_CHUNK_RECORDS*SETTINGS_RECORD_SIZE];
+        put_header(buf, SETTINGS_MAGIC, analyzer->calibration_len_);
+        put_f32(buf+8, analyzer->z0_);
+        buf[12] = analyzer->interpolation_;
+        buf[13] = analyzer->average_samples_;
+        put_f32(buf+16, analyzer->average_tolerance_);
+        uint32_t crc = 0xFFFFFFFF;
+        if(!write_block(&out, buf, PERSISTENCE_HEADER_SIZE, &crc)) {
+            return false;
+        }
 
-            int file_number = str2int(filename+prefix_len, name_len-prefix_len);
-            if (file_number > max_file_number) {
-                max_file_number = file_number;
-                strcpy(max_filename, filename);
+        for(size_t start=0; start<analyzer->calibration_len_; start+=PERSISTENCE_CHUNK_RECORDS) {
+            size_t n = min((size_t)PERSISTENCE_CHUNK_RECORDS, analyzer->calibration_len_-start);
+            for(size_t k=0; k<n; k++) {
+                uint8_t* record = buf + k*SETTINGS_RECORD_SIZE;
+                const CalibrationPoint &cal = analyzer->calibration_results_[start+k];
+                put_u32(record, cal.fq);
+                put_complex(record+4, cal.cal_short);
+                put_complex(record+12, cal.cal_open);
+                put_complex(record+20, cal.cal_load);
             }
+            if(!write_block(&out, buf, n*SETTINGS_RECORD_SIZE, &crc)) {
+                return false;
+            }
+        }
+        return write_crc(&out, crc);
+    }
 
-            entry->close();
+    bool load_settings_binary(FsFile* entry, Analyzer* analyzer, size_t max_cal_len) {
+        uint8_t buf[PERSISTENCE_CHUNK_RECORDS*SETTINGS_RECORD_SIZE];
+        uint16_t count;
+        FileReader in(entry);
+        if(!check_binary(entry, &in, SETTINGS_MAGIC, SETTINGS_RECORD_SIZE, max_cal_len, buf, &count)) {
+            persistence_logger.error("failed to load settings");
+            return false;
+        }
+        // the records reuse buf, and nothing is committed until they're in
+        float z0 = get_f32(buf+8);
+        uint8_t interpolation = buf[12] == CAL_INTERP_CUBIC ? CAL_INTERP_CUBIC : CAL_INTERP_LINEAR;
+        uint8_t average_samples = constrain(buf[13], 1, AVERAGE_MAX_SAMPLES);
+        float average_tolerance = get_f32(buf+16);
+
+        for(size_t start=0; start<count; start+=PERSISTENCE_CHUNK_RECORDS) {
+            size_t n = min((size_t)PERSISTENCE_CHUNK_RECORDS, count-start);
+            if(in.read(buf, n*SETTINGS_RECORD_SIZE) != n*SETTINGS_RECORD_SIZE) {
+                persistence_logger.error(String("failed to read settings file error ")+entry->getError());
+                if(start > 0) {
+                    // part of the old calibration was overwritten, don't use
+                    // what's left of it
+                    persistence_logger.warn(F("dropping partly loaded calibration"));
+                    analyzer->calibration_len_ = 0;
+                    analyzer->calibration_changed();
+                }
+                return false;
+            }
+            for(size_t k=0; k<n; k++) {
+                const uint8_t* record = buf + k*SETTINGS_RECORD_SIZE;
+                CalibrationPoint &cal = analyzer->calibration_results_[start+k];
+                cal.fq = get_u32(record);
+                cal.cal_short = get_complex(record+4);
+                cal.cal_open = get_complex(record+12);
+                cal.cal_load = get_complex(record+20);
+            }
         }
+        analyzer->z0_ = z0;
+        analyzer->interpolation_ = interpolation;
+        analyzer->average_samples_ = average_samples;
+        analyzer->average_tolerance_ = average_tolerance;
+        analyzer->calibration_len_ = count;
+        analyzer->solve_calibration();
+        analyzer->calibration_changed();
 
-        if (max_file_number >= 0) {
-            if(!entry->open(directory, max_filename, O_RDONLY)) {
-                char dirname[128];
-                directory->getName(dirname, 128);
-                persistence_logger.error(String("could not open ")+max_filename+" in "+dirname);
+        persistence_logger.info("loaded settings");
+        return true;
+    }
+
+    // opens the highest numbered file, giving the manifest one chance to
+    // catch up if it names a file that's gone
+    bool open_latest(DirectoryManifest* manifest, FsFile* directory, FsFile* entry) {
+        ManifestEntry latest;
+        for(int tries=0; tries<2; tries++) {
+            if(!manifest->latest(&latest)) {
                 return false;
             }
+            if(entry->open(directory, latest.name, O_RDONLY)) {
+                persistence_logger.info(String("latest file is ")+latest.name);
+                return true;
+            }
+            persistence_logger.warn(String("could not open ")+latest.name);
+            manifest->invalidate();
+        }
+        return false;
+    }
+
+    static bool file_timestamp(FsFile* entry, ManifestEntry* summary) {
+        uint16_t date;
+        uint16_t time;
+        // the directory entry is only up to date after a sync
+        if(!entry->sync() || !entry->getModifyDateTime(&date, &time)) {
+            return false;
+        }
+        summary->timestamp = ((uint32_t)date << 16) | time;
+        return true;
+    }
+
+    static void summarize_settings(const char* name, const Analyzer* analyzer, ManifestEntry* summary) {
+        summary->clear();
+        strncpy(summary->name, name, MANIFEST_NAME_LEN-1);
+        summary->points = analyzer->calibration_len_;
+        if(analyzer->calibration_len_ > 0) {
+            summary->start_fq = analyzer->calibration_results_[0].fq;
+            summary->end_fq = analyzer->calibration_results_[analyzer->calibration_len_-1].fq;
+        }
+    }
+
+    // min SWR is with the calibration at the time of saving
+    static void summarize_results(const char* name, const SweepBuffer* results, const Analyzer* analyzer, ManifestEntry* summary) {
+        summary->clear();
+        strncpy(summary->name, name, MANIFEST_NAME_LEN-1);
+        summary->points = results->len_;
+        if(results->len_ == 0) {
+            return;
+        }
+        summary->start_fq = results->fq_[0];
+        summary->end_fq = results->fq_[results->len_-1];
+        SweepBlock block;
+        CalibrationCursor cursor;
+        for(size_t start=0; start<results->len_; start+=SWEEP_BLOCK) {
+            size_t n = gather_sweep_block(analyzer, *results, NULL, start, &cursor, &block);
+            calibrate_sweep_block(&block, analyzer->z0_);
+            for(size_t k=0; k<n; k++) {
+                float swr = compute_swr(Complex(block.gamma_re[k], block.gamma_im[k]));
+                if(!(swr >= summary->min_swr)) {
+                    summary->min_swr = swr;
+                    summary->min_swr_fq = results->fq_[start+k];
+                }
+            }
+        }
+    }
+
+    // summaries for manifest rebuilds, from the file alone. binary files
+    // only need their header (and for settings the first and last record),
+    // JSON files are parsed for their fq values.
+    static bool summarize_settings_file(FsFile* directory, const char* name, ManifestEntry* summary) {
+        return summarize_file(directory, name, SETTINGS_MAGIC, summary);
+    }
+
+    static bool summarize_results_file(FsFile* directory, const char* name, ManifestEntry* summary) {
+        return summarize_file(directory, name, RESULTS_MAGIC, summary);
+    }
+
+    static bool summarize_file(FsFile* directory, const char* name, const char* magic, ManifestEntry* summary) {
+        FsFile entry;
+        if(!entry.open(directory, name, O_RDONLY)) {
+            return false;
+        }
+        uint16_t date;
+        uint16_t time;
+        if(entry.getModifyDateTime(&date, &time)) {
+            summary->timestamp = ((uint32_t)date << 16) | time;
+        }
+        bool ok = is_binary(name) ? summarize_binary(&entry, magic, summary) : summarize_json(&entry, summary);
+        entry.close();
+        return ok;
+    }
+
+    static bool summarize_binary(FsFile* entry, const char* magic, ManifestEntry* summary) {
+        uint8_t header[PERSISTENCE_HEADER_SIZE];
+        if(entry->read(header, PERSISTENCE_V1_HEADER_SIZE) != PERSISTENCE_V1_HEADER_SIZE || memcmp(header, magic, 4) != 0) {
+            return false;
+        }
+        uint16_t version = get_u16(header+4);
+        summary->points = get_u16(header+6);
+        if(summary->points == 0) {
             return true;
-        } else {
+        }
+        if(memcmp(magic, RESULTS_MAGIC, 4) == 0) {
+            summary->start_fq = get_u32(header+12);
+            summary->end_fq = get_u32(header+16);
+            if(version >= 2 && entry->read(header+PERSISTENCE_V1_HEADER_SIZE, PERSISTENCE_HEADER_SIZE-PERSISTENCE_V1_HEADER_SIZE) == PERSISTENCE_HEADER_SIZE-PERSISTENCE_V1_HEADER_SIZE) {
+                summary->min_swr = get_f32(header+24);
+                summary->min_swr_fq = get_u32(header+28);
+            }
+            return true;
+        }
+        // settings records start with their fq
+        size_t header_size = version < 2 ? PERSISTENCE_V1_HEADER_SIZE : PERSISTENCE_HEADER_SIZE;
+        uint8_t fq[sizeof(uint32_t)];
+        if(!entry->seekSet(header_size) || entry->read(fq, sizeof(fq)) != sizeof(fq)) {
             return false;
         }
+        summary->start_fq = get_u32(fq);
+        if(!entry->seekSet(header_size + (summary->points-1)*SETTINGS_RECORD_SIZE) || entry->read(fq, sizeof(fq)) != sizeof(fq)) {
+            return false;
+        }
+        summary->end_fq = get_u32(fq);
+        return true;
+    }
+
+    static bool summarize_json(FsFile* entry, ManifestEntry* summary) {
+        JsonTokenizer tokenizer;
+        SummaryJsonListener listener(summary);
+        FileReader in(entry);
+        int c;
+        while((c = in.read()) >= 0) {
+            tokenizer.parse(c, &listener);
+        }
+        return !in.failed() && !tokenizer.has_error_;
     }
 };
 
@@ -5,162 +5,367 @@
 
 Logger process_logger("process");
 
+enum ANALYSIS_STEP { ANALYSIS_MEASURE, ANALYSIS_DRAW, ANALYSIS_DONE };
+// sweeps the plan one short step per call so loop() keeps polling input
+// between steps. each step either measures one reading, which blocks until
+// the Zero II has it, or draws progress.
+//
+// an adaptive sweep measures every other plan point first and then spends
+// the rest of the budget splitting whichever interval has the biggest change
+// in calibrated gamma, so points cluster around dips and resonances
+//
+// with averaging on each point is re-measured until the analyzer's
+// averaging settings are satisfied before moving on to the next one
 class AnalysisProcessor {
     public:
-    void initialize(uint32_t start_fq, uint32_t end_fq, uint16_t steps, AnalysisPoint* results) {
-        start_fq_ = start_fq;
-        end_fq_ = end_fq;
-        fq_ = start_fq;
-        if(end_fq > start_fq && steps > 1) {
-            steps_ = steps;
-            step_fq_ = pow(((double)end_fq)/((double)start_fq), 1.0/((double)steps_-1));
-        } else {
-            steps_ = 0;
-            step_fq_ = 1.0;
-        }
+    void initialize(const FrequencyPlan* plan, SweepBuffer* results, bool adaptive=false) {
+        plan_ = plan;
+        steps_ = min(plan->len(), results->max_len_);
         results_ = results;
+        results_->len_ = 0;
         result_idx_ = 0;
+        if (adaptive && steps_ >= 4) {
+            // every other point, always including the last one
+            coarse_stride_ = 2;
+            coarse_steps_ = steps_ / 2 + 1;
+        } else {
+            coarse_stride_ = 1;
+            coarse_steps_ = steps_;
+        }
 
-        process_logger.info(String("analyzing startFq ")+start_fq+" endFq "+end_fq+" steps "+steps+" step_fq "+step_fq_);
+        process_logger.info(String("analyzing startFq ")+plan->start_fq_+" endFq "+plan->end_fq_+" steps "+steps_+" coarse steps "+coarse_steps_);
+        live_ = false;
         tft.fillScreen(BLACK);
         draw_title();
         initialize_progress_meter("Analyzing...");
+        begin();
     }
 
-    bool analyze() {
-        if (result_idx_ >= steps_) {
-            return true;
-        }
+    // one pass of a live sweep: no progress meter and, once results hold a
+    // full pass, points are overwritten in place so the trace stays complete
+    void initialize_live(const FrequencyPlan* plan, SweepBuffer* results) {
+        plan_ = plan;
+        steps_ = min(plan->len(), results->max_len_);
+        results_ = results;
+        result_idx_ = 0;
+        coarse_stride_ = 1;
+        coarse_steps_ = steps_;
+        live_ = true;
+        begin();
+    }
 
-        process_logger.debug(String("analyzing fq ")+fq_+" idx "+result_idx_);
-        Complex z = analyzer.uncalibrated_measure(fq_);
-        results_[result_idx_] = AnalysisPoint(fq_, z);
-        result_idx_++;
-        fq_ = next_fq(fq_, result_idx_);
+    // index of the point stored by the last analyze() call, if any
+    bool measured_point(size_t* idx) {
+        if (!measured_) {
+            return false;
+        }
+        measured_ = false;
+        *idx = measured_idx_;
+        return true;
+    }
 
-        // update progress meter
-        draw_progress_meter(steps_, result_idx_);
+    void begin() {
+        measured_ = false;
+        average_.reset();
+        if (steps_ > 0) {
+            begin_coarse(0);
+            analysis_state_ = ANALYSIS_MEASURE;
+        } else {
+            analysis_state_ = ANALYSIS_DONE;
+        }
+    }
 
-        return false;
+    bool analyze() {
+        switch(analysis_state_) {
+            case ANALYSIS_MEASURE: {
+                uint32_t fq = fq_;
+                average_.add(analyzer.uncalibrated_measure(fq));
+                if (!analyzer.average_done(average_)) {
+                    // same point again on the next call
+                    return false;
+                }
+                process_logger.debug(String("analyzed fq ")+fq+" idx "+result_idx_+" samples "+average_.samples_);
+                // coarse points arrive in order, refinements get inserted
+                if (live_ && result_idx_ < results_->len_) {
+                    results_->set(result_idx_, fq, average_.mean(), average_.samples_, segment_);
+                } else {
+                    results_->insert(fq, average_.mean(), average_.samples_, segment_);
+                }
+                average_.reset();
+                // live sweeps go in plan order so this is where it landed
+                measured_idx_ = result_idx_;
+                measured_ = true;
+                result_idx_++;
+                if (result_idx_ < coarse_steps_) {
+                    begin_coarse(result_idx_);
+                } else if (result_idx_ < steps_) {
+                    uint32_t next_fq = refinement_fq(&segment_);
+                    if (next_fq == 0) {
+                        process_logger.info(String("nothing left to refine after ")+result_idx_+" points");
+                        steps_ = result_idx_;
+                    } else {
+                        fq_ = next_fq;
+                    }
+                }
+                analysis_state_ = ANALYSIS_DRAW;
+                return false;
+            }
+            case ANALYSIS_DRAW:
+                if (!live_) {
+                    draw_progress_meter(steps_, result_idx_);
+                }
+                analysis_state_ = result_idx_ < steps_ ? ANALYSIS_MEASURE : ANALYSIS_DONE;
+                return analysis_state_ == ANALYSIS_DONE;
+            default:
+                return true;
+        }
     }
 
+    // stop early keeping whatever points were already measured
+    void cancel() {
+        analysis_state_ = ANALYSIS_DONE;
+        process_logger.info(String("analysis cancelled after ")+result_idx_+" of "+steps_);
+    }
 
     private:
-    AnalysisPoint* results_;
-    uint32_t fq_;
-    double step_fq_;
+    const FrequencyPlan* plan_;
+    SweepBuffer* results_;
     size_t result_idx_;
-
-    uint32_t start_fq_;
-    uint32_t end_fq_;
     size_t steps_;
+    size_t coarse_steps_;
+    size_t coarse_stride_;
+    uint8_t analysis_state_;
+    bool live_;
+    bool measured_;
+    size_t measured_idx_;
+    MeasurementAverage average_;
+    // frequency of the point being measured
+    uint32_t fq_;
+    // plan segment of the point being measured
+    uint8_t segment_;
 
-    uint32_t next_fq(uint32_t fq_, size_t result_idx_) {
-        if(result_idx_ == steps_-1) {
-            return end_fq_;
-        } else {
-            return constrain((uint32_t)round((double)fq_ * step_fq_), start_fq_, end_fq_);
+    void begin_coarse(size_t i) {
+        size_t plan_idx = min(i * coarse_stride_, steps_ - 1);
+        segment_ = plan_->segment_of(plan_idx);
+        fq_ = plan_->fq(plan_idx);
+    }
+
+    // midpoint of the interval where calibrated gamma moves the most,
+    // weighted towards low SWR so a dip wins over a noisy high SWR region.
+    // distance in the complex plane covers both magnitude and phase changes.
+    // the gaps between plan segments are never split.
+    // returns 0 if no interval can be split any further.
+    uint32_t refinement_fq(uint8_t* segment) {
+        CalibrationCursor cursor;
+        float best_score = 0;
+        size_t best_i = 0;
+        Complex prev_gamma = analyzer.calibrated_gamma((*results_)[0], &cursor);
+        float prev_swr = compute_swr(prev_gamma);
+        for (size_t i = 1; i < results_->len_; i++) {
+            Complex gamma = analyzer.calibrated_gamma((*results_)[i], &cursor);
+            float swr = compute_swr(gamma);
+            if (results_->fq_[i] - results_->fq_[i-1] >= 2 && results_->segment(i) == results_->segment(i-1)) {
+                float score = (gamma - prev_gamma).modulus() / min(swr, prev_swr);
+                if (score > best_score) {
+                    best_score = score;
+                    best_i = i;
+                }
+            }
+            prev_gamma = gamma;
+            prev_swr = swr;
+        }
+        if (best_i == 0) {
+            return 0;
+        }
+        *segment = results_->segment(best_i);
+        return results_->fq_[best_i-1] + (results_->fq_[best_i] - results_->fq_[best_i-1]) / 2;
+    }
+};
+
+// minimum time between the start of live sweep passes, keeps short sweeps
+// from spending all their time redrawing
+#define LIVE_MIN_PASS_MS 250
+
+// sweeps plan over and over, updating the graph in place as each point
+// comes in
+class LiveSweep {
+    public:
+    void initialize(FrequencyPlan* plan, SweepBuffer* results, GraphContext* graph) {
+        plan_ = plan;
+        results_ = results;
+        graph_ = graph;
+        passes_ = 0;
+        start_pass();
+    }
+
+    void live_step() {
+        if (pass_done_) {
+            if (millis() - pass_start_ >= LIVE_MIN_PASS_MS) {
+                start_pass();
+            }
+            return;
         }
+
+        bool done = processor_.analyze();
+        size_t idx;
+        if (processor_.measured_point(&idx)) {
+            analysis_results_generation++;
+            derived_results.update_point(*results_, idx, analysis_results_generation, &analyzer, plan_);
+            graph_->update_point(idx);
+        }
+        if (done) {
+            graph_->finish_live_pass();
+            pass_done_ = true;
+            passes_++;
+            process_logger.debug(String("live pass ")+passes_+" took "+(millis()-pass_start_)+"ms");
+        }
+    }
+
+    private:
+    AnalysisProcessor processor_;
+    FrequencyPlan* plan_;
+    SweepBuffer* results_;
+    GraphContext* graph_;
+    uint32_t pass_start_;
+    uint32_t passes_;
+    bool pass_done_;
+
+    void start_pass() {
+        pass_start_ = millis();
+        pass_done_ = false;
+        plan_->relate(&analyzer);
+        processor_.initialize_live(plan_, results_);
     }
 };
 
-enum CAL_STEP { CAL_START, CAL_S_START, CAL_S, CAL_O_START, CAL_O, CAL_L_START, CAL_L, CAL_END };
+enum CAL_STEP { CAL_START, CAL_CHECK, CAL_STANDARD_START, CAL_STANDARD, CAL_END };
+enum CAL_STANDARD { CAL_SHORT, CAL_OPEN, CAL_LOAD };
+const char* cal_standard_names[] = { "short", "open", "load" };
+
+// a full calibration goes short, open, load. a partial one starts with the
+// load already connected for the spot check.
+const uint8_t cal_full_order[] = { CAL_SHORT, CAL_OPEN, CAL_LOAD };
+const uint8_t cal_partial_order[] = { CAL_LOAD, CAL_SHORT, CAL_OPEN };
+#define CAL_STANDARDS 3
+
+// kept calibration points are spot checked one per this many points
+#define CAL_CHECK_STRIDE 8
+// how far (in gamma) a load reading can move from the stored one before
+// the points around it get re-measured
+#define CAL_DRIFT_TOLERANCE 0.02
+
+// measures the short, open and load standards at every plan frequency
+//
+// a partial calibration keeps the existing calibration points whose
+// frequencies are still in the plan. it measures the load at one kept point
+// out of every CAL_CHECK_STRIDE, and if that moved too far the points around
+// it are measured again. once the checks are done the kept points are moved
+// to their place in the new plan and only missing and drifted points are
+// measured for each standard, straight into results.
 class Calibrator {
     public:
     Calibrator(Analyzer* analyzer) {
         analyzer_ = analyzer;
+        source_ = NULL;
+    }
+
+    ~Calibrator() {
+        delete [] source_;
     }
-    void initialize(uint32_t start_fq, uint32_t end_fq, uint16_t steps, CalibrationPoint* results) {
+
+    // for a partial calibration results must be the analyzer's calibration
+    // and plan must already be related to it. either way results must have
+    // room for every plan point.
+    void initialize(const FrequencyPlan* plan, CalibrationPoint* results, bool partial=false) {
         calibration_state_ = CAL_START;
-        start_fq_ = start_fq;
-        end_fq_ = end_fq;
-        fq_ = start_fq;
-        if(end_fq > start_fq && steps > 1) {
-            steps_ = steps;
-            step_fq_ = pow(((double)end_fq)/((double)start_fq), 1.0/((double)steps_-1));
+        plan_ = plan;
+        steps_ = plan->len();
+        results_ = results;
+        kept_ = 0;
+        if (partial) {
+            source_ = new uint16_t[steps_];
+            if (source_ == NULL) {
+                process_logger.warn(F("no room to track kept calibration points, calibrating everything"));
+            }
+        }
+        if (source_ != NULL) {
+            for (size_t i = 0; i < steps_; i++) {
+                source_[i] = plan->calibration_index(i);
+                if (source_[i] != NO_CALIBRATION_INDEX) {
+                    kept_++;
+                }
+            }
+        }
+        if (kept_ == 0) {
+            // nothing to keep, measure everything
+            delete [] source_;
+            source_ = NULL;
+            order_ = cal_full_order;
+            needed_ = steps_;
         } else {
-            steps_ = 0;
-            step_fq_ = 1.0;
+            order_ = cal_partial_order;
+            needed_ = steps_ - kept_;
         }
-        results_ = results;
-        result_idx_ = 0;
+        standard_idx_ = 0;
 
-        process_logger.info(String("calibrating startFq ")+start_fq+" endFq "+end_fq+" steps "+steps+" step_fq "+step_fq_);
+        process_logger.info(String("calibrating startFq ")+plan->start_fq_+" endFq "+plan->end_fq_+" steps "+steps_+" keeping "+kept_);
         tft.fillScreen(BLACK);
         draw_title();
     }
+
     bool calibration_step() {
         switch(calibration_state_) {
             case CAL_START:
-                tft.setTextSize(2);
-                tft.fillRect(0, 6*2*8, tft.width(), 2*8*3, BLACK);
-                tft.setCursor(0, 7*2*8);
-                tft.println(F("connect short and press knob"));
-                calibration_state_ = CAL_S_START;
+                prompt_standard();
+                calibration_state_ = CAL_STANDARD_START;
                 break;
-            // all three "start" cases are the same
-            // just increment the state on click
-            case CAL_S_START:
-            case CAL_O_START:
-            case CAL_L_START:
+            case CAL_STANDARD_START:
                 if (click) {
                     tft.fillRect(0, 7*2*8, tft.width(), 2*8, BLACK);
-                    process_logger.info(String("calibration start state ")+calibration_state_);
-                    calibration_state_++;
-                    fq_ = start_fq_;
-                    result_idx_ = 0;
-                    initialize_progress_meter("Calibrating...");
+                    process_logger.info(String("calibration start ")+cal_standard_names[order_[standard_idx_]]);
+                    plan_idx_ = 0;
+                    if (source_ != NULL && standard_idx_ == 0) {
+                        // partial calibration, see what we can keep first
+                        check_segment_ = 0;
+                        initialize_progress_meter("Checking...");
+                        calibration_state_ = CAL_CHECK;
+                    } else {
+                        start_standard();
+                    }
                 }
                 break;
-            case CAL_S:
-                if(result_idx_ < steps_) {
-                    process_logger.debug(String("calibrating ")+fq_);
-                    results_[result_idx_].cal_short = compute_gamma(analyzer_->uncalibrated_measure(fq_), analyzer_->z0_);
-                    results_[result_idx_].fq = fq_;
-                    result_idx_++;
-                    fq_ = next_fq(fq_, result_idx_);
-                    draw_progress_meter(steps_, result_idx_);
+            case CAL_CHECK:
+                if (plan_idx_ < steps_) {
+                    check_segment();
+                    draw_progress_meter((kept_ + CAL_CHECK_STRIDE - 1) / CAL_CHECK_STRIDE, check_segment_);
                 } else {
-                    process_logger.info(F("done calibrating short."));
-                    tft.setTextSize(2);
-                    tft.fillRect(0, 6*2*8, tft.width(), 2*8*3, BLACK);
-                    tft.setCursor(0, 7*2*8);
-                    tft.println(F("connect open and press knob"));
-                    calibration_state_ = CAL_O_START;
+                    finish_check();
+                    // the load is still connected, carry straight on
+                    plan_idx_ = 0;
+                    start_standard();
                 }
                 break;
-            case CAL_O:
-                if(result_idx_ < steps_) {
-                    process_logger.debug(String("calibrating ")+fq_);
-                    results_[result_idx_].cal_open = compute_gamma(analyzer_->uncalibrated_measure(fq_), analyzer_->z0_);
-                    result_idx_++;
-                    fq_ = next_fq(fq_, result_idx_);
-                    draw_progress_meter(steps_, result_idx_);
+            case CAL_STANDARD:
+                if (measured_idx_ < needed_) {
+                    measure_standard();
+                    draw_progress_meter(needed_, measured_idx_);
                 } else {
-                    process_logger.info(F("done calibrating open."));
-                    tft.setTextSize(2);
-                    tft.fillRect(0, 6*2*8, tft.width(), 2*8*3, BLACK);
-                    tft.setCursor(0, 7*2*8);
-                    tft.println(F("connect load and press knob"));
-                    calibration_state_ = CAL_L_START;
-                }
-                break;
-            case CAL_L:
-                if(result_idx_ < steps_) {
-                    process_logger.debug(String("calibrating ")+fq_);
-                    results_[result_idx_].cal_load = compute_gamma(analyzer_->uncalibrated_measure(fq_), analyzer_->z0_);
-                    result_idx_++;
-                    fq_ = next_fq(fq_, result_idx_);
-                    draw_progress_meter(steps_, result_idx_);
-                } else {
-                    process_logger.info(F("done calibrating load."));
-                    tft.setTextSize(2);
-                    tft.fillRect(0, 6*2*8, tft.width(), 2*8*3, BLACK);
-                    tft.setCursor(0, 6*2*8);
-                    tft.println(F("done calibrating."));
-                    calibration_state_ = CAL_END;
-                    // we're done!
-                    return true;
+                    process_logger.info(String("done calibrating ")+cal_standard_names[order_[standard_idx_]]);
+                    standard_idx_++;
+                    // if everything passed the spot check we're done already
+                    if (standard_idx_ < CAL_STANDARDS && needed_ > 0) {
+                        prompt_standard();
+                        calibration_state_ = CAL_STANDARD_START;
+                    } else {
+                        finish();
+                        tft.setTextSize(2);
+                        tft.fillRect(0, 6*2*8, tft.width(), 2*8*3, BLACK);
+                        tft.setCursor(0, 6*2*8);
+                        tft.println(F("done calibrating."));
+                        calibration_state_ = CAL_END;
+                        // we're done!
+                        return true;
+                    }
                 }
                 break;
         }
@@ -171,20 +376,136 @@ class Calibrator {
     Analyzer* analyzer_;
     uint8_t calibration_state_;
 
-    uint32_t start_fq_;
-    uint32_t end_fq_;
-
-    uint32_t fq_;
-    double step_fq_;
+    const FrequencyPlan* plan_;
     CalibrationPoint* results_;
     size_t steps_;
-    size_t result_idx_;
 
-    uint32_t next_fq(uint32_t fq_, size_t result_idx_) {
-        if(result_idx_ == steps_-1) {
-            return end_fq_;
-        } else {
-            return constrain((uint32_t)round((double)fq_ * step_fq_), start_fq_, end_fq_);
+    const uint8_t* order_;
+    size_t standard_idx_;
+    // for each plan point, the kept calibration point or
+    // NO_CALIBRATION_INDEX if it needs measuring. NULL means measure all.
+    uint16_t* source_;
+    size_t kept_;
+    size_t needed_;
+    size_t measured_idx_;
+    size_t plan_idx_;
+    size_t check_segment_;
+
+    void prompt_standard() {
+        tft.setTextSize(2);
+        tft.fillRect(0, 6*2*8, tft.width(), 2*8*3, BLACK);
+        tft.setCursor(0, 7*2*8);
+        tft.println(String("connect ")+cal_standard_names[order_[standard_idx_]]+" and press knob");
+    }
+
+    bool needs_measuring(size_t i) {
+        return source_ == NULL || source_[i] == NO_CALIBRATION_INDEX;
+    }
+
+    void start_standard() {
+        measured_idx_ = 0;
+        initialize_progress_meter("Calibrating...");
+        calibration_state_ = CAL_STANDARD;
+    }
+
+    Complex measure_gamma(uint32_t fq) {
+        uint8_t samples;
+        Complex gamma = compute_gamma(analyzer_->averaged_measure(fq, &samples), analyzer_->z0_);
+        process_logger.debug(String("calibrating ")+fq+" averaged "+samples+" readings");
+        return gamma;
+    }
+
+    // spot check the middle of the next CAL_CHECK_STRIDE kept points and
+    // mark all of them for measuring if the load there has drifted
+    void check_segment() {
+        if (check_segment_*CAL_CHECK_STRIDE >= kept_) {
+            // every kept point has been checked, skip any new points left
+            plan_idx_ = steps_;
+            return;
+        }
+        size_t segment_start = plan_idx_;
+        size_t segment_len = min((size_t)CAL_CHECK_STRIDE, kept_ - check_segment_*CAL_CHECK_STRIDE);
+        size_t seen = 0;
+        size_t check_idx = steps_;
+        while (plan_idx_ < steps_ && seen < segment_len) {
+            if (!needs_measuring(plan_idx_)) {
+                if (seen == segment_len / 2) {
+                    check_idx = plan_idx_;
+                }
+                seen++;
+            }
+            plan_idx_++;
+        }
+        if (seen < segment_len || check_idx == steps_) {
+            // ran off the end of the plan, nothing left to check
+            plan_idx_ = steps_;
+            return;
+        }
+        check_segment_++;
+
+        const CalibrationPoint &kept = results_[source_[check_idx]];
+        float drift = (measure_gamma(kept.fq) - kept.cal_load).modulus();
+        if (drift > CAL_DRIFT_TOLERANCE) {
+            process_logger.info(String("load drifted ")+drift+" at "+kept.fq+", re-measuring "+segment_len+" points");
+            for (size_t i = segment_start; i < plan_idx_; i++) {
+                source_[i] = NO_CALIBRATION_INDEX;
+            }
+        }
+    }
+
+    // move the kept points to where they go in the new plan so the rest can
+    // be measured in place. sources ascend along with the plan, so points
+    // moving down are moved front to back and points moving up back to
+    // front and nothing gets overwritten before it's read.
+    void finish_check() {
+        kept_ = 0;
+        for (size_t i = 0; i < steps_; i++) {
+            if (!needs_measuring(i)) {
+                kept_++;
+                if (source_[i] > i) {
+                    results_[i] = results_[source_[i]];
+                }
+            }
+        }
+        for (size_t i = steps_; i > 0; i--) {
+            if (!needs_measuring(i-1) && source_[i-1] < i-1) {
+                results_[i-1] = results_[source_[i-1]];
+            }
+        }
+        needed_ = steps_ - kept_;
+        process_logger.info(String("keeping ")+kept_+" calibration points, measuring "+needed_);
+    }
+
+    void measure_standard() {
+        while (!needs_measuring(plan_idx_)) {
+            plan_idx_++;
+        }
+        uint32_t fq = plan_->fq(plan_idx_);
+        CalibrationPoint &p = results_[plan_idx_];
+        Complex gamma = measure_gamma(fq);
+        switch(order_[standard_idx_]) {
+            case CAL_SHORT:
+                p.cal_short = gamma;
+                break;
+            case CAL_OPEN:
+                p.cal_open = gamma;
+                break;
+            case CAL_LOAD:
+                p.cal_load = gamma;
+                break;
+        }
+        p.fq = fq;
+        plan_idx_++;
+        measured_idx_++;
+    }
+
+    // all three standards are in, solve the new points' error terms. the
+    // kept ones were solved when they were first measured.
+    void finish() {
+        for (size_t i = 0; i < steps_; i++) {
+            if (needs_measuring(i)) {
+                results_[i].solve();
+            }
         }
     }
 };
@@ -280,6 +601,11 @@ class FqSetter {
 
 #define NUM_BANDS 19
 #define BAND_10M 11
+const uint32_t band_fqs[NUM_BANDS][2] = { {135700, 137800}, {472000, 479000}, {1800000, 2000000}, {3500000, 4000000}, {5330500, 5406400}, {7000000, 7300000}, {10100000, 10150000}, {14000000, 14350000}, {18068000, 18168000}, {21000000, 21450000}, {24890000, 24990000}, {28000000, 29700000}, {50000000, 54000000}, {144000000, 148000000}, {219000000, 225000000}, {420000000, 450000000}, {902000000, 928000000}, {100000, 600000000}, {100000, 1000000000} };
+const char* band_names[NUM_BANDS] = {F("2200m"), F("630m"), F("160m"), F("80m"), F("60m"), F("40m"), F("30m"), F("20m"), F("17m"), F("15m"), F("12m"), F("10m"), F("6m"), F("VHF"), F("1.25m"), F("UHF"), F("33cm"), F("Reference RF"), F("Full Range")};
+
+// picks a single band, or in multi band mode any number of bands to sweep
+// together as the segments of one plan
 class BandSetter {
     public:
     void initialize(uint32_t start_fq, uint32_t end_fq) {
@@ -320,11 +646,105 @@ class BandSetter {
         *end_fq = band_fqs[band_idx_][1];
     }
 
-    const uint32_t band_fqs[NUM_BANDS][2] = { {135700, 137800}, {472000, 479000}, {1800000, 2000000}, {3500000, 4000000}, {5330500, 5406400}, {7000000, 7300000}, {10100000, 10150000}, {14000000, 14350000}, {18068000, 18168000}, {2100000, 21450000}, {24890000, 24990000}, {28000000, 29700000}, {50000000, 54000000}, {144000000, 148000000}, {219000000, 225000000}, {420000000, 450000000}, {902000000, 928000000}, {100000, 600000000}, {100000, 1000000000} };
-    const char* band_names[NUM_BANDS] = {F("2200m"), F("630m"), F("160m"), F("80m"), F("60m"), F("40m"), F("30m"), F("20m"), F("17m"), F("15m"), F("12m"), F("10m"), F("6m"), F("VHF"), F("1.25m"), F("UHF"), F("33cm"), F("Reference RF"), F("Full Range")};
+    // bands matching one of segments start out selected. turning moves
+    // through the bands and a final "Done", clicking toggles a band.
+    void initialize_multi(const PlanSegment* segments, size_t count) {
+        selected_ = 0;
+        for (size_t b = 0; b < NUM_BANDS; b++) {
+            for (size_t s = 0; s < count; s++) {
+                if (band_fqs[b][0] == segments[s].start_fq && band_fqs[b][1] == segments[s].end_fq) {
+                    selected_ |= 1ul << b;
+                }
+            }
+        }
+        band_idx_ = 0;
+        tft.fillScreen(BLACK);
+        draw_title();
+        tft.setTextSize(2);
+        tft.setCursor(0, 5*2*8);
+        tft.println(F("Bands:"));
+        draw_multi_setting();
+    }
+
+    bool set_bands() {
+        if (click) {
+            if (band_idx_ == NUM_BANDS) {
+                return true;
+            }
+            selected_ ^= 1ul << band_idx_;
+            draw_multi_setting();
+        } else if (turn != 0) {
+            band_idx_ = constrain((int32_t)band_idx_+turn, 0, NUM_BANDS);
+            draw_multi_setting();
+        }
+        return false;
+    }
+
+    void draw_multi_setting() {
+        tft.setTextSize(3);
+        tft.fillRect(0, 6*2*8, tft.width(), 2*8*3, BLACK);
+        tft.setCursor(0, 6*2*8);
+        if (band_idx_ == NUM_BANDS) {
+            tft.println(F("    Done"));
+        } else {
+            tft.print(selected_ & (1ul << band_idx_) ? "[x] " : "[ ] ");
+            tft.println(band_names[band_idx_]);
+        }
+
+        // everything selected so far underneath
+        tft.setTextSize(2);
+        tft.fillRect(0, 10*2*8, tft.width(), 4*2*8, BLACK);
+        tft.setCursor(0, 10*2*8);
+        for (size_t b = 0; b < NUM_BANDS; b++) {
+            if (selected_ & (1ul << b)) {
+                tft.print(band_names[b]);
+                tft.print(" ");
+            }
+        }
+    }
+
+    // the selected bands in ascending order with any overlapping ones
+    // merged, at most max_segments of them. steps are left for the caller.
+    size_t segments(PlanSegment* segments, size_t max_segments) {
+        size_t count = 0;
+        for (size_t b = 0; b < NUM_BANDS; b++) {
+            if (!(selected_ & (1ul << b))) {
+                continue;
+            }
+            uint32_t start_fq = band_fqs[b][0];
+            uint32_t end_fq = band_fqs[b][1];
+            // insertion sort by start, the table is nearly sorted anyway
+            size_t i = count;
+            while (i > 0 && segments[i-1].start_fq > start_fq) {
+                i--;
+            }
+            if (i > 0 && segments[i-1].end_fq >= start_fq) {
+                // overlaps the previous one
+                segments[i-1].end_fq = max(segments[i-1].end_fq, end_fq);
+                i--;
+            } else if (count == max_segments) {
+                process_logger.warn(String("too many bands, dropping ")+band_names[b]);
+                continue;
+            } else {
+                memmove(&segments[i+1], &segments[i], sizeof(PlanSegment)*(count-i));
+                segments[i].start_fq = start_fq;
+                segments[i].end_fq = end_fq;
+                segments[i].steps = 0;
+                count++;
+            }
+            // growing a segment can swallow the ones after it
+            while (i+1 < count && segments[i+1].start_fq <= segments[i].end_fq) {
+                segments[i].end_fq = max(segments[i].end_fq, segments[i+1].end_fq);
+                memmove(&segments[i+1], &segments[i+2], sizeof(PlanSegment)*(count-i-2));
+                count--;
+            }
+        }
+        return count;
+    }
 
     private:
     size_t band_idx_;
+    uint32_t selected_;
 };
 
 class UserValueSetter {
@@ -378,6 +798,12 @@ class UserValueSetter {
     int32_t max_value_;
 };
 
+// rows of files on screen at once, the browser scrolls through the rest
+#define FILE_BROWSER_ROWS 12
+
+// Lists the files in a directory's manifest, newest first, with their point
+// count and best SWR. Only the rows on screen are loaded, so a directory
+// with many files costs no more memory than one with a few.
 class FileBrowser {
     public:
     FileBrowser() : file_menu_(NULL), file_options_(NULL) {}
@@ -389,13 +815,13 @@ class FileBrowser {
         }
     }
 
-    bool initialize(FsFile* directory, bool with_new) {
+    bool initialize(DirectoryManifest* manifest, bool with_new) {
         process_logger.debug(F("initializing file browser"));
 
         tft.fillScreen(BLACK);
         draw_title();
 
-        if(!directory->isOpen() || !directory->isDirectory()) {
+        if(!manifest->refresh()) {
             return false;
         }
         if (file_menu_) {
@@ -405,43 +831,15 @@ class FileBrowser {
             file_options_ = NULL;
         }
 
+        manifest_ = manifest;
         with_new_ = with_new;
+        file_count_ = manifest_->count() + (with_new_ ? 1 : 0);
+        selected_ = 0;
+        first_ = 0;
 
-        process_logger.debug(F("counting files in directory"));
-
-        // awkward to iterate through directory once to get count and a second
-        // time to actually get the names into the array. not sure how else to
-        // do it with an array of MenuOptions (no stl shenanigans)
-        size_t file_count = 0;
-        directory->rewindDirectory();
-        FsFile entry;
-        while(entry.openNext(directory, O_RDONLY)) {
-            file_count++;
-        }
-
-        process_logger.debug(F("allocating file options"));
-
-        size_t idx;
-        if (with_new_) {
-            file_count++;
-            file_options_ = new MenuOption[file_count];
-            file_options_[0].label = String("New File");
-            idx = 1;
-        } else {
-            file_options_ = new MenuOption[file_count];
-            idx = 0;
-        }
-
-        process_logger.debug(F("iterating through directory"));
-
-        directory->rewindDirectory();
-        while(entry.openNext(directory, O_RDONLY) && idx < file_count) {
-            char filename[128];
-            entry.getName(filename, sizeof(filename));
-            file_options_[idx++].label = String(filename);
-        }
-
-        file_menu_ = new Menu(NULL, file_options_, file_count);
+        file_options_ = new MenuOption[FILE_BROWSER_ROWS];
+        file_menu_ = new Menu(NULL, file_options_, min((size_t)FILE_BROWSER_ROWS, file_count_));
+        load_rows();
 
         draw_menu(file_menu_, -1, true);
         return true;
@@ -450,9 +848,22 @@ class FileBrowser {
     bool choose_file() {
         if (click) {
             return true;
-        } else if (turn != 0 && file_menu_->option_count > 0) {
-            file_menu_->selected_option = constrain((int32_t)file_menu_->selected_option+turn, 0, file_menu_->option_count-1);
-            draw_menu(file_menu_, -1, false);
+        } else if (turn != 0 && file_count_ > 0) {
+            selected_ = constrain((int32_t)selected_+turn, 0, (int32_t)file_count_-1);
+            bool scrolled = false;
+            if (selected_ < first_) {
+                first_ = selected_;
+                scrolled = true;
+            } else if (selected_ >= first_ + FILE_BROWSER_ROWS) {
+                first_ = selected_ - FILE_BROWSER_ROWS + 1;
+                scrolled = true;
+            }
+            if (scrolled) {
+                clear_menu(file_menu_);
+                load_rows();
+            }
+            file_menu_->selected_option = selected_ - first_;
+            draw_menu(file_menu_, -1, scrolled);
             return false;
         } else {
             return false;
@@ -460,15 +871,55 @@ class FileBrowser {
     }
 
     bool is_new() {
-        return with_new_ && file_menu_->selected_option == 0;
+        return with_new_ && selected_ == 0;
     }
 
     void file(char* filename, size_t max_len) {
-        file_options_[file_menu_->selected_option].label.toCharArray(filename, max_len);
+        ManifestEntry entry;
+        filename[0] = '\0';
+        if (manifest_entry(selected_, &entry)) {
+            strncpy(filename, entry.name, max_len-1);
+            filename[max_len-1] = '\0';
+        }
     }
 
     private:
+    // row i of the list, counting "New File" if there is one
+    bool manifest_entry(size_t i, ManifestEntry* entry) {
+        if (with_new_) {
+            if (i == 0) {
+                return false;
+            }
+            i--;
+        }
+        size_t count = manifest_->count();
+        return i < count && manifest_->entry(count-1-i, entry);
+    }
+
+    void load_rows() {
+        ManifestEntry entry;
+        for (size_t row=0; row<file_menu_->option_count; row++) {
+            size_t i = first_ + row;
+            String &label = file_options_[row].label;
+            if (with_new_ && i == 0) {
+                label = String("New File");
+            } else if (manifest_entry(i, &entry)) {
+                label = String(entry.name)+" "+entry.points+"pt";
+                if (!isnan(entry.min_swr)) {
+                    label += String(" ")+String(entry.min_swr, 2);
+                }
+            } else {
+                label = String("?");
+            }
+        }
+    }
+
+    DirectoryManifest* manifest_;
     bool with_new_;
+    size_t file_count_;
+    // both are positions in the whole list, not the rows on screen
+    size_t selected_;
+    size_t first_;
     MenuOption* file_options_;
     Menu* file_menu_;
 };
@@ -0,0 +1,112 @@
+#ifndef _RESULTS_H
+#define _RESULTS_H
+
+#include "log.h"
+#include "analyzer.h"
+#include "frequency_plan.h"
+#include "sweep_buffer.h"
+
+Logger results_logger("results");
+
+// everything we show about a result point, computed once per change in
+// results, calibration or z0. fq and segment are read from the results.
+struct DerivedPoint {
+    Complex gamma;
+    Complex z;
+    float swr;
+    float return_loss;
+};
+
+class DerivedResults {
+    public:
+        DerivedResults(DerivedPoint* points) {
+            points_ = points;
+            results_ = NULL;
+            len_ = 0;
+            generation_ = 0;
+            valid_ = false;
+        }
+
+        // rebuild from results if they or the analyzer changed since the
+        // last update, returns true if anything was rebuilt
+        // plan, if given, is the plan the results were swept with and lets
+        // us index calibration points directly
+        bool update(const SweepBuffer &results, uint32_t results_generation, const Analyzer* analyzer, const FrequencyPlan* plan=NULL) {
+            if(valid_ && results_generation == results_generation_ && analyzer->generation_ == analyzer_generation_) {
+                return false;
+            }
+
+            // results are in sweep order so one cursor walks the calibration
+            // alongside them instead of searching for every point
+            SweepBlock block;
+            CalibrationCursor cursor;
+            for(size_t start=0; start<results.len_; start+=SWEEP_BLOCK) {
+                size_t n = gather_sweep_block(analyzer, results, plan, start, &cursor, &block);
+                calibrate_sweep_block(&block, analyzer->z0_);
+                for(size_t k=0; k<n; k++) {
+                    DerivedPoint &p = points_[start+k];
+                    p.gamma = Complex(block.gamma_re[k], block.gamma_im[k]);
+                    p.z = compute_z(p.gamma, analyzer->z0_);
+                    p.swr = compute_swr(p.gamma);
+                    p.return_loss = compute_return_loss(p.gamma);
+                }
+            }
+            results_ = &results;
+            len_ = results.len_;
+            results_generation_ = results_generation;
+            analyzer_generation_ = analyzer->generation_;
+            valid_ = true;
+            generation_++;
+
+            results_logger.debug(String("rebuilt derived results generation ")+generation_);
+            return true;
+        }
+
+        // recompute just point i after it was measured, e.g. during a live
+        // sweep where rebuilding everything per point would be quadratic.
+        // i can be at most one past the end to append a point.
+        void update_point(const SweepBuffer &results, size_t i, uint32_t results_generation, const Analyzer* analyzer, const FrequencyPlan* plan=NULL) {
+            if(!valid_ || analyzer->generation_ != analyzer_generation_ || i > len_ || results.len_ > len_ + 1) {
+                update(results, results_generation, analyzer, plan);
+                return;
+            }
+
+            DerivedPoint &p = points_[i];
+            p.gamma = analyzer->calibrated_gamma(results[i], plan ? plan->calibration_index(i) : NO_CALIBRATION_INDEX);
+            p.z = compute_z(p.gamma, analyzer->z0_);
+            p.swr = compute_swr(p.gamma);
+            p.return_loss = compute_return_loss(p.gamma);
+
+            results_ = &results;
+            len_ = results.len_;
+            results_generation_ = results_generation;
+            generation_++;
+        }
+
+        const DerivedPoint& operator[](size_t i) const {
+            return points_[i];
+        }
+
+        uint32_t fq(size_t i) const {
+            return results_->fq_[i];
+        }
+
+        // plan segment point i was measured in
+        uint8_t segment(size_t i) const {
+            return results_->segment(i);
+        }
+
+        size_t len_;
+        // bumped on every rebuild so views can tell if they're stale
+        uint32_t generation_;
+
+    private:
+        DerivedPoint* points_;
+        // the results points_ were derived from
+        const SweepBuffer* results_;
+        bool valid_;
+        uint32_t results_generation_;
+        uint32_t analyzer_generation_;
+};
+
+#endif //_RESULTS_H
@@ -0,0 +1,154 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "log.h"
+
+Logger scheduler_logger("scheduler");
+
+#define MAX_TASKS 8
+
+typedef void (*TaskFunction)();
+
+struct Task {
+    const char* name_;
+    TaskFunction fn_;
+    // breaks ties between tasks with the same deadline, lower goes first
+    uint8_t priority_;
+    // ms between runs, 0 for a one shot task that runs once per schedule()
+    uint32_t period_;
+    // ms after becoming due by which the task should have started
+    uint32_t deadline_;
+    // us a single run should take
+    uint32_t budget_;
+
+    bool active_;
+    uint32_t due_;
+
+    uint32_t runs_;
+    // runs that took longer than budget_
+    uint32_t overruns_;
+    // runs that started after their deadline
+    uint32_t misses_;
+    uint32_t max_us_;
+
+    uint32_t absolute_deadline() const {
+        return due_ + deadline_;
+    }
+};
+
+// Cooperative scheduler for everything loop() does. Each call to run()
+// runs at most one due task: the one with the earliest deadline, then the
+// highest priority. Tasks have to return quickly, long jobs (sweeps,
+// screenshots) do a short step per run, so nothing starves encoder input.
+class Scheduler {
+    public:
+        Scheduler() {
+            len_ = 0;
+        }
+
+        // periodic tasks start out due, one shot tasks wait for schedule()
+        Task* add(const char* name, TaskFunction fn, uint8_t priority, uint32_t period, uint32_t deadline, uint32_t budget) {
+            if(len_ == MAX_TASKS) {
+                scheduler_logger.error(String("too many tasks, can't add ")+name);
+                return NULL;
+            }
+            Task* t = &tasks_[len_++];
+            t->name_ = name;
+            t->fn_ = fn;
+            t->priority_ = priority;
+            t->period_ = period;
+            t->deadline_ = deadline;
+            t->budget_ = budget;
+            t->active_ = period > 0;
+            t->due_ = millis();
+            t->runs_ = 0;
+            t->overruns_ = 0;
+            t->misses_ = 0;
+            t->max_us_ = 0;
+            return t;
+        }
+
+        // make t due delay ms from now
+        void schedule(Task* t, uint32_t delay=0) {
+            if(t == NULL) {
+                return;
+            }
+            t->due_ = millis() + delay;
+            t->active_ = true;
+        }
+
+        void cancel(Task* t) {
+            if(t == NULL) {
+                return;
+            }
+            t->active_ = false;
+        }
+
+        // returns true if a task ran
+        bool run() {
+            uint32_t now = millis();
+            Task* next = NULL;
+            for(size_t i=0; i<len_; i++) {
+                Task* t = &tasks_[i];
+                if(!t->active_ || (int32_t)(now - t->due_) < 0) {
+                    continue;
+                }
+                if(next == NULL) {
+                    next = t;
+                    continue;
+                }
+                int32_t slack = t->absolute_deadline() - next->absolute_deadline();
+                if(slack < 0 || (slack == 0 && t->priority_ < next->priority_)) {
+                    next = t;
+                }
+            }
+            if(next == NULL) {
+                return false;
+            }
+
+            if((int32_t)(now - next->absolute_deadline()) > 0) {
+                next->misses_++;
+            }
+            if(next->period_ > 0) {
+                next->due_ += next->period_;
+                if((int32_t)(now - next->due_) >= 0) {
+                    // fell behind, skip the missed runs instead of
+                    // running back to back to catch up
+                    next->due_ = now + next->period_;
+                }
+            } else {
+                next->active_ = false;
+            }
+
+            uint32_t start = micros();
+            next->fn_();
+            uint32_t elapsed = micros() - start;
+
+            next->runs_++;
+            if(elapsed > next->budget_) {
+                next->overruns_++;
+                // only log the worst so far, overruns tend to repeat
+                if(elapsed > next->max_us_) {
+                    scheduler_logger.warn(String("task ")+next->name_+" took "+elapsed+"us, budget "+next->budget_+"us");
+                }
+            }
+            if(elapsed > next->max_us_) {
+                next->max_us_ = elapsed;
+            }
+            return true;
+        }
+
+        void reset_stats() {
+            for(size_t i=0; i<len_; i++) {
+                tasks_[i].runs_ = 0;
+                tasks_[i].overruns_ = 0;
+                tasks_[i].misses_ = 0;
+                tasks_[i].max_us_ = 0;
+            }
+        }
+
+        Task tasks_[MAX_TASKS];
+        size_t len_;
+};
+
+#endif //_SCHEDULER_H
@@ -7,6 +7,8 @@
 #include <RTClib.h>
 #include <SdFat.h>
 
+#include "file_stream.h"
+
 #ifdef __arm__
 // should use uinstd.h to define sbrk but Due causes a conflict
 extern "C" char* sbrk(int incr);
@@ -164,32 +166,36 @@ void shellfn_result(size_t argc, char* argv[]) {
     }
 
     int idx = atoi(argv[1]);
-    if(idx >= analysis_results_len) {
-        Serial.println(String("idx ")+idx+" >= "+analysis_results_len);
+    if(idx >= analysis_results.len_) {
+        Serial.println(String("idx ")+idx+" >= "+analysis_results.len_);
     } else {
         Serial.println(String("result idx\t")+idx);
         Serial.print("Raw:\t");
         Serial.println(analysis_results[idx].uncal_z);
         Serial.print("Uncal gamma:\t");
         Serial.println(compute_gamma(analysis_results[idx].uncal_z, 50));
+        const DerivedResults& derived = update_derived_results();
         Serial.print("Cal gamma:\t");
-        Serial.println(analyzer.calibrated_gamma(analysis_results[idx]));
+        Serial.println(derived[idx].gamma);
         Serial.print("SWR:\t");
-        Serial.println(compute_swr(analyzer.calibrated_gamma(analysis_results[idx])));
+        Serial.println(derived[idx].swr);
     }
 }
 
 void shellfn_results(size_t argc, char* argv[]) {
-    for (size_t i=0; i<analysis_results_len; i++) {
+    const DerivedResults& derived = update_derived_results();
+    for (size_t i=0; i<analysis_results.len_; i++) {
         Serial.print(analysis_results[i].fq);
         Serial.print("\t");
         Serial.print(analysis_results[i].uncal_z);
         Serial.print("\t");
         Serial.print(compute_gamma(analysis_results[i].uncal_z, 50));
         Serial.print("\t");
-        Serial.print(analyzer.calibrated_gamma(analysis_results[i]));
+        Serial.print(derived[i].gamma);
+        Serial.print("\t");
+        Serial.print(derived[i].swr);
         Serial.print("\t");
-        Serial.println(compute_swr(analyzer.calibrated_gamma(analysis_results[i])));
+        Serial.println(analysis_results.samples(i));
     }
 }
 
@@ -197,6 +203,64 @@ void shellfn_menu_state(size_t argc, char* argv[]) {
     Serial.println(menu_manager.current_option_);
 }
 
+// the monitor streams one reading per scheduler run so input and the rest
+// of the UI keep going while it runs
+Task* shell_monitor_task = NULL;
+Monitor shell_monitor(&analyzer);
+uint32_t shell_monitor_left = 0;
+
+void shell_monitor_step() {
+    // any input stops early, including the start of the next command
+    if(shell_monitor_left == 0 || Serial.available() > 0 || serial_command_len > 0) {
+        shell_monitor.finish();
+        shell_monitor_left = 0;
+        Serial.println("monitor done");
+        return;
+    }
+    if(shell_monitor.poll()) {
+        const MonitorReading& r = shell_monitor.reading();
+        Serial.print(r.fq);
+        Serial.print("\t");
+        Serial.print(r.z.real(), 2);
+        Serial.print("\t");
+        Serial.print(r.z.imag(), 2);
+        Serial.print("\t");
+        Serial.print(r.z.modulus(), 2);
+        Serial.print("\t");
+        Serial.print(r.swr, 3);
+        Serial.print("\t");
+        Serial.println(r.return_loss, 2);
+        shell_monitor_left--;
+    }
+    scheduler.schedule(shell_monitor_task);
+}
+
+void shellfn_monitor(size_t argc, char* argv[]) {
+    if(argc < 2) {
+        Serial.println("usage: `monitor FQ [COUNT]` streams COUNT readings at FQ, any input stops early");
+        return;
+    }
+    uint32_t fq = atol(argv[1]);
+    uint32_t count = argc > 2 ? atol(argv[2]) : 10;
+    if(fq < MIN_FQ || fq > MAX_FQ) {
+        Serial.println(String("fq must be between ")+MIN_FQ+" and "+MAX_FQ);
+        return;
+    }
+    if(shell_monitor_left > 0) {
+        Serial.println("monitor already running");
+        return;
+    }
+    if(shell_monitor_task == NULL) {
+        Serial.println("monitor needs the scheduler running");
+        return;
+    }
+
+    shell_monitor.initialize(fq);
+    shell_monitor_left = count;
+    Serial.println("fq\tR\tX\t|Z|\tSWR\tRL");
+    scheduler.schedule(shell_monitor_task);
+}
+
 
 void shellfn_batt(size_t argc, char* argv[]) {
     uint16_t batt_raw = analogRead(A3);
@@ -307,6 +371,8 @@ void shellfn_rm(size_t argc, char* argv[]) {
         Serial.println("remove failed");
         return;
     }
+    // the manifests can't tell which files the shell touched
+    persistence.invalidate_manifests();
     Serial.println(String("removed ")+target_name);
 }
 
@@ -351,6 +417,7 @@ void shellfn_mv(size_t argc, char* argv[]) {
         Serial.println("move failed");
         return;
     }
+    persistence.invalidate_manifests();
     Serial.println(String("moved ")+target_name+" to "+new_name);
 }
 
@@ -368,6 +435,7 @@ void shellfn_touch(size_t argc, char* argv[]) {
     }
     target.sync();
     target.close();
+    persistence.invalidate_manifests();
 
     Serial.println("touched");
 }
@@ -385,8 +453,13 @@ void shellfn_cat(size_t argc, char* argv[]) {
         return;
     }
 
-    while(target.available()) {
-        Serial.write(target.read());
+    {
+        FileReader in(&target);
+        uint8_t buf[64];
+        size_t n;
+        while((n = in.read(buf, sizeof(buf))) > 0) {
+            Serial.write(buf, n);
+        }
     }
 
     target.close();
@@ -474,11 +547,58 @@ void write_color16_as_24(T &writer, uint16_t pixel) {
     writer.write(b);
 }
 
+// the screenshot is written a few rows per scheduler run so input and
+// measurements keep going while it's saved. anything that redraws in the
+// meantime can show up partly drawn.
+#define SCREENSHOT_ROWS_PER_STEP 4
+
+Task* screenshot_task = NULL;
+FsFile screenshot_file;
+bool screenshot_active = false;
+size_t screenshot_row;
+uint8_t screenshot_padding;
+
+// writes the next rows, returns true when the screenshot is done
+bool screenshot_rows() {
+    // the stream buffer can't be held between scheduler runs, so each run
+    // flushes what it wrote
+    FileWriter out(&screenshot_file);
+    const size_t width = tft.width();
+    // rows are stored bottom to top, unsigned row wraps around past row 0
+    for(size_t n = 0; n < SCREENSHOT_ROWS_PER_STEP && screenshot_row < (size_t)tft.height(); n++, screenshot_row--) {
+        for(size_t col = 0; col<width; col++) {
+            uint16_t pixel = tft.readPixel(col, screenshot_row);
+            write_color16_as_24(out, pixel);
+        }
+        //fill out the padding
+        for(size_t i=0; i<screenshot_padding; i++) {
+            out.write((uint8_t)0u);
+        }
+        Serial.print(".");
+    }
+    return screenshot_row >= (size_t)tft.height();
+}
+
+void screenshot_step() {
+    if(!screenshot_rows()) {
+        scheduler.schedule(screenshot_task);
+        return;
+    }
+    Serial.println("done");
+    screenshot_file.close();
+    screenshot_active = false;
+    Serial.println("screenshot saved");
+}
+
 void shellfn_screenshot(size_t argc, char* argv[]) {
     if (argc < 2) {
         Serial.println("usage: screenshot filepath");
         return;
     }
+    if (screenshot_active) {
+        Serial.println("screenshot already in progress");
+        return;
+    }
 
     const char* target_name = argv[1];
 
@@ -494,11 +614,11 @@ void shellfn_screenshot(size_t argc, char* argv[]) {
     const uint32_t file_size = bitmap_size + image_offset;
     const uint8_t padding = row_size - width*bmp_depth/8;
 
-    FsFile target;
-    if(!target.open(target_name, O_RDWR | O_CREAT | O_TRUNC)) {
+    if(!screenshot_file.open(target_name, O_RDWR | O_CREAT | O_TRUNC)) {
         Serial.println(String("could not open ")+target_name+" for append");
         return;
     }
+    FileWriter target(&screenshot_file);
 
     Serial.println("writing header");
     // BMP header (14 bytes)
@@ -547,26 +667,33 @@ void shellfn_screenshot(size_t argc, char* argv[]) {
     // rows are padded to multiple of 32 bits (row_size)
     // rows are stored bottom to top
     // tft pixels are 16-bit 565 format and we need to explode that into 24-bit
-    Serial.print("writing pixel data");
-
-    // unsigned value will wrap around to a large number after row 0,
-    // so we check that row < height for the loop condition
-    for(size_t row = height-1; row < height; row--) {
-        for(size_t col = 0; col<width; col++) {
-            uint16_t pixel = tft.readPixel(col, row);
-            write_color16_as_24(target, pixel);
-        }
-        //fill out the padding
-        for(size_t i=0; i<padding; i++) {
-            target.write((uint8_t)0u);
+    Serial.println(String("writing pixel data to ")+target_name);
+
+    target.flush();
+    screenshot_active = true;
+    screenshot_row = height-1;
+    screenshot_padding = padding;
+    if(screenshot_task) {
+        scheduler.schedule(screenshot_task);
+    } else {
+        // no scheduler yet, e.g. during setup
+        while(screenshot_active) {
+            screenshot_step();
         }
-        Serial.print(".");
     }
-    Serial.println("done");
-
-    target.close();
+}
 
-    Serial.println(String("screenshot saved to ")+target_name);
+void shellfn_tasks(size_t argc, char* argv[]) {
+    if(argc > 1 && strcmp(argv[1], "reset") == 0) {
+        scheduler.reset_stats();
+        Serial.println("reset task stats");
+        return;
+    }
+    Serial.println("task\tprio\tperiod\truns\tover\tmissed\tmax_us\tbudget_us");
+    for(size_t i=0; i<scheduler.len_; i++) {
+        const Task &t = scheduler.tasks_[i];
+        Serial.println(String(t.name_)+"\t"+t.priority_+"\t"+t.period_+"\t"+t.runs_+"\t"+t.overruns_+"\t"+t.misses_+"\t"+t.max_us_+"\t"+t.budget_);
+    }
 }
 
 void shellfn_date(size_t argc, char* argv[]) {
@@ -625,6 +752,8 @@ const char* SHELL_COMMANDS[] = {
     "result",
     "results",
     "menu_state",
+    "monitor",
+    "tasks",
 };
 
 
@@ -662,7 +791,9 @@ const shell_command_t SHELL_FUNCTIONS[] = {
 
     shellfn_result,
     shellfn_results,
-    shellfn_menu_state
+    shellfn_menu_state,
+    shellfn_monitor,
+    shellfn_tasks
 };
 
 typedef char CHECK_SHELL_COMMANDS[sizeof(SHELL_COMMANDS) / sizeof(SHELL_COMMANDS[0]) == sizeof(SHELL_FUNCTIONS)/sizeof(SHELL_FUNCTIONS[0]) ? 1 : -1];
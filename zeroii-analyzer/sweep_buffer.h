@@ -0,0 +1,207 @@
+#ifndef _SWEEP_BUFFER_H
+#define _SWEEP_BUFFER_H
+
+#if defined(__SSE2__) && !defined(SWEEP_NO_SIMD)
+#include <emmintrin.h>
+#endif
+
+#include "analyzer.h"
+#include "frequency_plan.h"
+
+// Sweep results stored as separate fq, real and imaginary arrays so the
+// calibration kernel below can work on several points at a time.
+// samples, if given, records how many readings were averaged per point and
+// segment which segment of a multi segment plan each point came from.
+class SweepBuffer {
+    public:
+        SweepBuffer(uint32_t* fq, float* re, float* im, size_t max_len, uint8_t* samples=NULL, uint8_t* segment=NULL) {
+            fq_ = fq;
+            re_ = re;
+            im_ = im;
+            samples_ = samples;
+            segment_ = segment;
+            max_len_ = max_len;
+            len_ = 0;
+        }
+
+        AnalysisPoint operator[](size_t i) const {
+            return AnalysisPoint(fq_[i], Complex(re_[i], im_[i]));
+        }
+
+        void set(size_t i, uint32_t fq, Complex uncal_z, uint8_t samples=1, uint8_t segment=0) {
+            fq_[i] = fq;
+            re_[i] = uncal_z.real();
+            im_[i] = uncal_z.imag();
+            if(samples_) {
+                samples_[i] = samples;
+            }
+            if(segment_) {
+                segment_[i] = segment;
+            }
+        }
+
+        uint8_t samples(size_t i) const {
+            return samples_ ? samples_[i] : 1;
+        }
+
+        uint8_t segment(size_t i) const {
+            return segment_ ? segment_[i] : 0;
+        }
+
+        void set(size_t i, const AnalysisPoint &p) {
+            set(i, p.fq, p.uncal_z);
+        }
+
+        // insert a point keeping the buffer sorted by fq
+        bool insert(uint32_t fq, Complex uncal_z, uint8_t samples=1, uint8_t segment=0) {
+            if(len_ >= max_len_) {
+                return false;
+            }
+            size_t i = len_;
+            while(i > 0 && fq_[i-1] > fq) {
+                i--;
+            }
+            memmove(&fq_[i+1], &fq_[i], sizeof(uint32_t)*(len_-i));
+            memmove(&re_[i+1], &re_[i], sizeof(float)*(len_-i));
+            memmove(&im_[i+1], &im_[i], sizeof(float)*(len_-i));
+            if(samples_) {
+                memmove(&samples_[i+1], &samples_[i], sizeof(uint8_t)*(len_-i));
+            }
+            if(segment_) {
+                memmove(&segment_[i+1], &segment_[i], sizeof(uint8_t)*(len_-i));
+            }
+            len_++;
+            set(i, fq, uncal_z, samples, segment);
+            return true;
+        }
+
+        uint32_t* fq_;
+        float* re_;
+        float* im_;
+        uint8_t* samples_;
+        uint8_t* segment_;
+        size_t max_len_;
+        size_t len_;
+};
+
+#define SWEEP_BLOCK 4
+
+// measurements and error terms for a block of points, one array per
+// component so each step of the math runs across the whole block
+struct SweepBlock {
+    float z_re[SWEEP_BLOCK];
+    float z_im[SWEEP_BLOCK];
+    float e00_re[SWEEP_BLOCK];
+    float e00_im[SWEEP_BLOCK];
+    float e11_re[SWEEP_BLOCK];
+    float e11_im[SWEEP_BLOCK];
+    float e01e10_re[SWEEP_BLOCK];
+    float e01e10_im[SWEEP_BLOCK];
+
+    float gamma_re[SWEEP_BLOCK];
+    float gamma_im[SWEEP_BLOCK];
+};
+
+// fill block with up to SWEEP_BLOCK points of sweep starting at start
+// returns how many points were gathered. unused lanes repeat the last point
+// so the kernel never sees garbage.
+size_t gather_sweep_block(const Analyzer* analyzer, const SweepBuffer &sweep, const FrequencyPlan* plan, size_t start, CalibrationCursor* cursor, SweepBlock* block) {
+    size_t n = min((size_t)SWEEP_BLOCK, sweep.len_ - start);
+    CalibrationPoint scratch;
+    const CalibrationPoint* cal = NULL;
+    for(size_t k=0; k<SWEEP_BLOCK; k++) {
+        size_t i = start + min(k, n-1);
+        if(k < n) {
+            uint16_t cal_idx = plan ? plan->calibration_index(i) : NO_CALIBRATION_INDEX;
+            if(cal_idx < analyzer->calibration_len_ && analyzer->calibration_results_[cal_idx].fq == sweep.fq_[i]) {
+                cal = &analyzer->calibration_results_[cal_idx];
+            } else {
+                cal = analyzer->calibration_at(sweep.fq_[i], cursor, &scratch);
+            }
+        }
+        block->z_re[k] = sweep.re_[i];
+        block->z_im[k] = sweep.im_[i];
+        block->e00_re[k] = cal->e00.real();
+        block->e00_im[k] = cal->e00.imag();
+        block->e11_re[k] = cal->e11.real();
+        block->e11_im[k] = cal->e11.imag();
+        block->e01e10_re[k] = cal->e01e10.real();
+        block->e01e10_im[k] = cal->e01e10.imag();
+    }
+    return n;
+}
+
+// calibrated gamma for every lane of block
+// this is compute_gamma followed by correct_reflection written out by
+// component, with the operations in the same order as Complex so the
+// results are identical to the scalar path
+// define SWEEP_NO_SIMD to use the plain version on the host as well
+#if defined(__SSE2__) && !defined(SWEEP_NO_SIMD)
+void calibrate_sweep_block(SweepBlock* b, float z0) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one_f = _mm_set1_ps(1.0f);
+    __m128 z0v = _mm_set1_ps(z0);
+    __m128 zr = _mm_loadu_ps(b->z_re);
+    __m128 zi = _mm_loadu_ps(b->z_im);
+
+    // gamma = (z - z0)/(z + z0)
+    __m128 nr = _mm_sub_ps(zr, z0v);
+    __m128 ni = _mm_sub_ps(zi, zero);
+    __m128 dr = _mm_add_ps(zr, z0v);
+    __m128 di = _mm_add_ps(zi, zero);
+    __m128 f = _mm_div_ps(one_f, _mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(di, di)));
+    __m128 gr = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(nr, dr), _mm_mul_ps(ni, di)), f);
+    __m128 gi = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ni, dr), _mm_mul_ps(nr, di)), f);
+
+    // d = gamma - e00, cal_gamma = d/(e01e10 + e11*d)
+    __m128 d_r = _mm_sub_ps(gr, _mm_loadu_ps(b->e00_re));
+    __m128 d_i = _mm_sub_ps(gi, _mm_loadu_ps(b->e00_im));
+    __m128 e11r = _mm_loadu_ps(b->e11_re);
+    __m128 e11i = _mm_loadu_ps(b->e11_im);
+    __m128 cr = _mm_add_ps(_mm_loadu_ps(b->e01e10_re), _mm_sub_ps(_mm_mul_ps(e11r, d_r), _mm_mul_ps(e11i, d_i)));
+    __m128 ci = _mm_add_ps(_mm_loadu_ps(b->e01e10_im), _mm_add_ps(_mm_mul_ps(e11r, d_i), _mm_mul_ps(e11i, d_r)));
+    f = _mm_div_ps(one_f, _mm_add_ps(_mm_mul_ps(cr, cr), _mm_mul_ps(ci, ci)));
+    _mm_storeu_ps(b->gamma_re, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(d_r, cr), _mm_mul_ps(d_i, ci)), f));
+    _mm_storeu_ps(b->gamma_im, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(d_i, cr), _mm_mul_ps(d_r, ci)), f));
+}
+#else
+// the M4's SIMD instructions only work on packed integers, so on the target
+// this is plain single precision code. working a block at a time still
+// gives the FPU independent operations to pipeline.
+void calibrate_sweep_block(SweepBlock* b, float z0) {
+    for(size_t k=0; k<SWEEP_BLOCK; k++) {
+        float nr = b->z_re[k] - z0;
+        float ni = b->z_im[k] - 0.0f;
+        float dr = b->z_re[k] + z0;
+        float di = b->z_im[k] + 0.0f;
+        float f = 1.0f / (dr*dr + di*di);
+        float gr = (nr*dr + ni*di) * f;
+        float gi = (ni*dr - nr*di) * f;
+
+        float d_r = gr - b->e00_re[k];
+        float d_i = gi - b->e00_im[k];
+        float cr = b->e01e10_re[k] + (b->e11_re[k]*d_r - b->e11_im[k]*d_i);
+        float ci = b->e01e10_im[k] + (b->e11_re[k]*d_i + b->e11_im[k]*d_r);
+        f = 1.0f / (cr*cr + ci*ci);
+        b->gamma_re[k] = (d_r*cr + d_i*ci) * f;
+        b->gamma_im[k] = (d_i*cr - d_r*ci) * f;
+    }
+}
+#endif
+
+// calibrated gamma for the whole sweep
+// plan, if given, is the plan the sweep was measured with
+void calibrate_sweep(const Analyzer* analyzer, const SweepBuffer &sweep, const FrequencyPlan* plan, float* gamma_re, float* gamma_im) {
+    SweepBlock block;
+    CalibrationCursor cursor;
+    for(size_t start=0; start<sweep.len_; start+=SWEEP_BLOCK) {
+        size_t n = gather_sweep_block(analyzer, sweep, plan, start, &cursor, &block);
+        calibrate_sweep_block(&block, analyzer->z0_);
+        for(size_t k=0; k<n; k++) {
+            gamma_re[start+k] = block.gamma_re[k];
+            gamma_im[start+k] = block.gamma_im[k];
+        }
+    }
+}
+
+#endif //_SWEEP_BUFFER_H
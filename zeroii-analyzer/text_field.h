@@ -0,0 +1,54 @@
+#ifndef _TEXT_FIELD_H
+#define _TEXT_FIELD_H
+
+#define TEXT_FIELD_MAX_WIDTH 40
+
+// A fixed width line of text that remembers what's on screen, so drawing
+// new text only touches the characters that changed instead of clearing
+// the whole line and printing it again. Each changed character is drawn
+// with its background, so nothing needs clearing first.
+class TextField {
+    public:
+        void initialize(int16_t x, int16_t y, uint8_t text_size, uint8_t width, uint16_t color=WHITE) {
+            x_ = x;
+            y_ = y;
+            text_size_ = text_size;
+            width_ = min(width, (uint8_t)TEXT_FIELD_MAX_WIDTH);
+            color_ = color;
+            invalidate();
+        }
+
+        // something else drew over the field, redraw all of it next time
+        void invalidate() {
+            memset(shown_, 0, sizeof(shown_));
+        }
+
+        bool overlaps(int16_t x0, int16_t y0, int16_t x1, int16_t y1) const {
+            return x0 < x_ + width_*6*text_size_ && x1 >= x_ && y0 < y_ + 8*text_size_ && y1 >= y_;
+        }
+
+        // text longer than the field is cut off, shorter text is padded
+        // with blanks
+        void draw(const char* text) {
+            int16_t x = x_;
+            bool ended = false;
+            for (size_t c = 0; c < width_; c++, x += 6*text_size_) {
+                ended = ended || text[c] == '\0';
+                char ch = ended ? ' ' : text[c];
+                if (ch != shown_[c]) {
+                    tft.drawChar(x, y_, ch, color_, BLACK, text_size_);
+                    shown_[c] = ch;
+                }
+            }
+        }
+
+    private:
+        char shown_[TEXT_FIELD_MAX_WIDTH];
+        int16_t x_;
+        int16_t y_;
+        uint8_t text_size_;
+        uint8_t width_;
+        uint16_t color_;
+};
+
+#endif //_TEXT_FIELD_H
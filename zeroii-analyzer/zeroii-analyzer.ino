@@ -14,8 +14,12 @@ const __FlashStringHelper* test = F("foobar");
 
 #include "log.h"
 #include "analyzer.h"
+#include "frequency_plan.h"
+#include "sweep_buffer.h"
+#include "results.h"
 #include "menu_manager.h"
 #include "persistence.h"
+#include "scheduler.h"
 
 Logger loop_logger("loop");
 
@@ -118,6 +122,7 @@ Adafruit_TFTLCD tft(LCD_CS, LCD_CD, LCD_WR, LCD_RD, LCD_RESET);
 
 //TODO: cleanup graph.h so it doesn't have to be included here
 #include "graph.h"
+GraphContext* graph_context = NULL;
 
 #define ZERO_I2C_ADDRESS 0x5B
 #define CLK A2
@@ -130,16 +135,44 @@ Adafruit_TFTLCD tft(LCD_CS, LCD_CD, LCD_WR, LCD_RD, LCD_RESET);
 #define PROGRESS_METER_Y 8*2*4
 #define PROGRESS_METER_WIDTH (tft.width()-PROGRESS_METER_Y*2)
 
-// holds the most recent set of analysis results, initialize to zero length
-// array so we can realloc it below
-size_t analysis_results_len = 0;
-AnalysisPoint analysis_results[MAX_STEPS];
+// holds the most recent set of analysis results
+uint32_t analysis_results_fq[MAX_STEPS];
+float analysis_results_re[MAX_STEPS];
+float analysis_results_im[MAX_STEPS];
+uint8_t analysis_results_samples[MAX_STEPS];
+uint8_t analysis_results_segment[MAX_STEPS];
+SweepBuffer analysis_results(analysis_results_fq, analysis_results_re, analysis_results_im, MAX_STEPS, analysis_results_samples, analysis_results_segment);
 
 size_t calibration_len = 0;
 CalibrationPoint calibration_results[MAX_STEPS];
 
 Analyzer analyzer(Z0, calibration_results);
 
+// frequencies for the next analysis or calibration, see build_sweep_plan
+uint32_t sweep_plan_fqs[MAX_STEPS];
+uint16_t sweep_plan_calibration_idx[MAX_STEPS];
+FrequencyPlan sweep_plan(sweep_plan_fqs, sweep_plan_calibration_idx, MAX_STEPS);
+
+// bump whenever analysis_results changes so derived results get rebuilt
+uint32_t analysis_results_generation = 0;
+DerivedPoint derived_points[MAX_STEPS];
+DerivedResults derived_results(derived_points);
+
+// live sweeps borrow sweep_plan for their, usually smaller, plan and
+// rebuild it for the next analysis when they stop
+uint16_t live_steps = MAX_STEPS/4;
+
+// the plan analysis_results were swept with, NULL if that plan is gone
+FrequencyPlan* results_plan = &sweep_plan;
+
+const DerivedResults& update_derived_results() {
+    if(results_plan) {
+        results_plan->relate(&analyzer);
+    }
+    derived_results.update(analysis_results, analysis_results_generation, &analyzer, results_plan);
+    return derived_results;
+}
+
 AnalyzerPersistence persistence;
 
 void initialize_progress_meter(String label) {
@@ -184,9 +217,17 @@ SerialWombatDebouncedInput debounced_input(sw);
 int32_t turn = 0;
 uint16_t last_quad_enc = 32768;
 bool click = false;
+// input collected by input_task until option_task hands it to handle_option
+int32_t pending_turn = 0;
+bool pending_click = false;
+
+Scheduler scheduler;
+Task* error_task = NULL;
 
 enum MOPT {
     MOPT_ANALYZE,
+    MOPT_LIVE,
+    MOPT_MONITOR,
     MOPT_FQ,
     MOPT_RESULTS,
     MOPT_SETTINGS,
@@ -196,18 +237,27 @@ enum MOPT {
     MOPT_FQSTART,
     MOPT_FQEND,
     MOPT_FQBAND,
+    MOPT_FQBANDS,
     MOPT_FQSTEPS,
+    MOPT_FQSPACING,
+    MOPT_FQADAPTIVE,
 
     MOPT_SWR,
     MOPT_SMITH,
+    MOPT_LIVE_SWR,
+    MOPT_LIVE_SMITH,
     MOPT_SAVE_RESULTS,
     MOPT_LOAD_RESULTS,
 
     MOPT_CALIBRATE,
+    MOPT_RECALIBRATE,
     MOPT_Z0,
     MOPT_SAVE_SETTINGS,
     MOPT_LOAD_SETTINGS,
     MOPT_ZOOM_SMITH,
+    MOPT_CAL_INTERP,
+    MOPT_AVG_SAMPLES,
+    MOPT_AVG_TOLERANCE,
 
     MOPT_BACK,
 };
@@ -218,7 +268,10 @@ const MenuOption fq_menu_options[] = {
     MenuOption(F("Fq Center"), MOPT_FQCENTER, NULL),
     MenuOption(F("Fq Range"), MOPT_FQWINDOW, NULL),
     MenuOption(F("Fq Band"), MOPT_FQBAND, NULL),
+    MenuOption(F("Multi Band"), MOPT_FQBANDS, NULL),
     MenuOption(F("Steps"), MOPT_FQSTEPS, NULL),
+    MenuOption(F("Linear Steps"), MOPT_FQSPACING, NULL),
+    MenuOption(F("Adaptive Sweep"), MOPT_FQADAPTIVE, NULL),
     MenuOption(F("Back"), MOPT_BACK, NULL),
 };
 Menu fq_menu(NULL, fq_menu_options, sizeof(fq_menu_options)/sizeof(fq_menu_options[0]));
@@ -234,16 +287,29 @@ Menu results_menu(NULL, results_menu_options, sizeof(results_menu_options)/sizeo
 
 const MenuOption settings_menu_options[] = {
     MenuOption(F("Calibration"), MOPT_CALIBRATE, NULL),
+    MenuOption(F("Recalibrate"), MOPT_RECALIBRATE, NULL),
     MenuOption(F("Z0"), MOPT_Z0, NULL),
     MenuOption(F("Save Settings"), MOPT_SAVE_SETTINGS, NULL),
     MenuOption(F("Load Settings"), MOPT_LOAD_SETTINGS, NULL),
     MenuOption(F("Zoom Smith Chart"), MOPT_ZOOM_SMITH, NULL),
+    MenuOption(F("Cubic Cal Interp"), MOPT_CAL_INTERP, NULL),
+    MenuOption(F("Averaging"), MOPT_AVG_SAMPLES, NULL),
+    MenuOption(F("Avg Tolerance"), MOPT_AVG_TOLERANCE, NULL),
     MenuOption(F("Back"), MOPT_BACK, NULL),
 };
 Menu settings_menu(NULL, settings_menu_options, sizeof(settings_menu_options)/sizeof(settings_menu_options[0]));
 
+const MenuOption live_menu_options[] = {
+    MenuOption(F("Live SWR"), MOPT_LIVE_SWR, NULL),
+    MenuOption(F("Live Smith"), MOPT_LIVE_SMITH, NULL),
+    MenuOption(F("Back"), MOPT_BACK, NULL),
+};
+Menu live_menu(NULL, live_menu_options, sizeof(live_menu_options)/sizeof(live_menu_options[0]));
+
 const MenuOption root_menu_options[] = {
     MenuOption(F("Analyze"), MOPT_ANALYZE, NULL),
+    MenuOption(F("Live"), MOPT_LIVE, &live_menu),
+    MenuOption(F("Monitor"), MOPT_MONITOR, NULL),
     MenuOption(F("Frequencies"), MOPT_FQ, &fq_menu),
     MenuOption(F("Results"), MOPT_RESULTS, &results_menu),
     MenuOption(F("Settings"), MOPT_SETTINGS, &settings_menu),
@@ -255,6 +321,40 @@ MenuManager menu_manager(&root_menu);
 uint32_t start_fq = MIN_FQ;
 uint32_t end_fq = MAX_FQ;
 uint16_t step_count = MAX_STEPS/2;
+uint8_t plan_spacing = PLAN_LOG;
+// spend half the steps on a coarse pass and the rest refining
+bool adaptive_sweep = false;
+// ranges picked with multi band, swept together instead of start/end
+PlanSegment plan_segments[MAX_PLAN_SEGMENTS];
+size_t plan_segment_count = 0;
+
+// one segment per picked band with the steps shared out evenly
+bool build_segment_plan() {
+    for(size_t s=0; s<plan_segment_count; s++) {
+        plan_segments[s].steps = max(step_count*(s+1)/plan_segment_count - step_count*s/plan_segment_count, (size_t)1);
+    }
+    return sweep_plan.initialize_segments(plan_segments, plan_segment_count, plan_spacing == PLAN_LINEAR ? PLAN_LINEAR : PLAN_LOG);
+}
+
+// build sweep_plan from start/end/steps
+// a list plan (copied from the calibration) is kept as long as the user
+// hasn't changed the range or steps since
+bool build_sweep_plan() {
+    if(plan_segment_count > 0) {
+        return build_segment_plan();
+    }
+    if(plan_spacing == PLAN_LIST) {
+        if(sweep_plan.len() == step_count && sweep_plan.start_fq_ == start_fq && sweep_plan.end_fq_ == end_fq) {
+            return true;
+        }
+        plan_spacing = PLAN_LOG;
+    }
+    if(plan_spacing == PLAN_LINEAR) {
+        return sweep_plan.initialize_linear(start_fq, end_fq, step_count);
+    } else {
+        return sweep_plan.initialize_log(start_fq, end_fq, step_count);
+    }
+}
 
 bool set_analysis_from_calibration() {
     if(analyzer.calibration_len_ == 0) {
@@ -264,6 +364,16 @@ bool set_analysis_from_calibration() {
     start_fq = constrain(analyzer.calibration_results_[0].fq, MIN_FQ, MAX_FQ);
     end_fq = constrain(analyzer.calibration_results_[analyzer.calibration_len_-1].fq, MIN_FQ, MAX_FQ);
     step_count = constrain(analyzer.calibration_len_, 1, MAX_STEPS);
+    plan_segment_count = 0;
+
+    // sweep exactly the calibrated frequencies
+    uint32_t fqs[MAX_STEPS];
+    for(size_t i=0; i<step_count; i++) {
+        fqs[i] = analyzer.calibration_results_[i].fq;
+    }
+    if(sweep_plan.initialize_list(fqs, step_count)) {
+        plan_spacing = PLAN_LIST;
+    }
     return true;
 }
 
@@ -288,12 +398,21 @@ char error_message[64];
 void clear_error_display() {
     current_error("");
     tft.fillRect(0, tft.height()-8*TITLE_TEXT_SIZE, tft.width(), 8*TITLE_TEXT_SIZE, BLACK);
+    if (graph_context) {
+        graph_context->invalidate_text();
+    }
 }
 
 void current_error(const char* error_msg) {
     strncpy(error_message, error_msg, sizeof(error_message));
     last_error_time = millis();
     draw_error();
+    // clear it again once it's been up long enough
+    if (error_message[0]) {
+        scheduler.schedule(error_task, ERROR_MESSAGE_DWELL_TIME);
+    } else {
+        scheduler.cancel(error_task);
+    }
 }
 
 void draw_error() {
@@ -306,6 +425,9 @@ void draw_error() {
         tft.print(error_message);
 
         tft.setTextColor(WHITE);
+        if (graph_context) {
+            graph_context->invalidate_text();
+        }
     }
 }
 
@@ -410,6 +532,7 @@ int32_t set_user_value(int32_t current_value, int32_t min_value, int32_t max_val
  * loop invocations.
  ************/
 #include "process.h"
+#include "monitor.h"
 AnalysisProcessor* analysis_processor = NULL;
 Calibrator* calibrator = NULL;
 FqSetter* fq_setter = NULL;
@@ -417,9 +540,79 @@ BandSetter* band_setter = NULL;
 UserValueSetter* value_setter = NULL;
 FileBrowser* file_browser = NULL;
 ConfirmDialog* confirm_dialog = NULL;
-GraphContext* graph_context = NULL;
+LiveSweep* live_sweep = NULL;
+Monitor* monitor = NULL;
+MonitorScreen* monitor_screen = NULL;
 bool zoom_smith = true;
 
+// frequency the monitor watches, starts in the middle of the current range
+uint32_t monitor_fq = 0;
+
+void draw_monitor_title() {
+    tft.fillRect(0, 0, tft.width(), 8*TITLE_TEXT_SIZE*2, BLACK);
+    tft.setCursor(0,0);
+    tft.setTextSize(TITLE_TEXT_SIZE);
+    tft.println(String("Monitor ")+frequency_formatter(monitor_fq));
+    tft.print(F("turn to tune, click to exit"));
+}
+
+void draw_live_title() {
+    tft.fillRect(0, 0, tft.width(), 8*TITLE_TEXT_SIZE, BLACK);
+    tft.setCursor(0,0);
+    tft.setTextSize(TITLE_TEXT_SIZE);
+    tft.print(String("Live St:")+live_steps+" turn to change");
+}
+
+// (re)start a live sweep of live_steps points over the current range
+void start_live(bool smith) {
+    if(plan_spacing == PLAN_LINEAR) {
+        sweep_plan.initialize_linear(start_fq, end_fq, live_steps);
+    } else {
+        sweep_plan.initialize_log(start_fq, end_fq, live_steps);
+    }
+    results_plan = &sweep_plan;
+    analysis_results.len_ = 0;
+    analysis_results_generation++;
+
+    graph_context = new GraphContext(update_derived_results(), &analyzer);
+    if(graph_context == NULL) {
+        loop_logger.error(F("could not make a GraphContext"));
+    }
+    if(smith) {
+        graph_context->initialize_smith(zoom_smith);
+        graph_context->graph_smith();
+    } else {
+        graph_context->initialize_swr(sweep_plan.start_fq_, sweep_plan.end_fq_);
+        graph_context->graph_swr();
+    }
+    draw_live_title();
+
+    live_sweep = new LiveSweep();
+    if(live_sweep == NULL) {
+        loop_logger.error(F("could not make a LiveSweep"));
+    }
+    live_sweep->initialize(&sweep_plan, &analysis_results, graph_context);
+}
+
+void stop_live() {
+    delete live_sweep;
+    live_sweep = NULL;
+    delete graph_context;
+    graph_context = NULL;
+
+    // put back the plan for the next analysis. the live results keep no
+    // plan, they find their calibration points by frequency.
+    results_plan = NULL;
+    if(plan_spacing == PLAN_LIST && analyzer.calibration_len_ == step_count && analyzer.calibration_results_[0].fq == start_fq && analyzer.calibration_results_[step_count-1].fq == end_fq) {
+        set_analysis_from_calibration();
+    } else {
+        if(plan_spacing == PLAN_LIST) {
+            plan_spacing = PLAN_LOG;
+        }
+        build_sweep_plan();
+    }
+}
+
 bool browse_progress() {
     return file_browser->choose_file();
 }
@@ -427,13 +620,35 @@ bool browse_progress() {
 void enter_option(int32_t option_id) {
     loop_logger.debug(String("entering ")+option_id);
     switch(option_id) {
+        case MOPT_MONITOR:
+            if(monitor_fq < start_fq || monitor_fq > end_fq) {
+                monitor_fq = start_fq + (end_fq-start_fq)/2;
+            }
+            monitor = new Monitor(&analyzer);
+            monitor_screen = new MonitorScreen();
+            if(monitor == NULL || monitor_screen == NULL) {
+                loop_logger.error(F("could not make a Monitor"));
+            }
+            tft.fillScreen(BLACK);
+            draw_monitor_title();
+            monitor_screen->initialize();
+            monitor->initialize(monitor_fq);
+            break;
+        case MOPT_LIVE_SWR:
+            start_live(false);
+            break;
+        case MOPT_LIVE_SMITH:
+            start_live(true);
+            break;
         case MOPT_ANALYZE:
-            analysis_results_len = step_count;
+            results_plan = &sweep_plan;
+            build_sweep_plan();
+            analysis_results_generation++;
             analysis_processor = new AnalysisProcessor();
             if(analysis_processor == NULL) {
                 loop_logger.error(F("could not make an AnalysisProcessor"));
             }
-            analysis_processor->initialize(start_fq, end_fq, step_count, analysis_results);
+            analysis_processor->initialize(&sweep_plan, &analysis_results, adaptive_sweep);
             break;
         case MOPT_FQCENTER: {
             int32_t centerFq = start_fq + (end_fq-start_fq)/2;
@@ -477,24 +692,43 @@ void enter_option(int32_t option_id) {
             }
             band_setter->initialize(start_fq, end_fq);
             break;
+        case MOPT_FQBANDS:
+            band_setter = new BandSetter();
+            if(band_setter == NULL) {
+                loop_logger.error("could not make an BandSetter");
+            }
+            band_setter->initialize_multi(plan_segments, plan_segment_count);
+            break;
         case MOPT_FQSTEPS:
             value_setter = new UserValueSetter();
             value_setter->initialize("Steps", step_count, 1, 128);
             break;
+        case MOPT_FQSPACING:
+            value_setter = new UserValueSetter();
+            value_setter->initialize("Linear Steps", plan_spacing == PLAN_LINEAR, 0, 1);
+            break;
+        case MOPT_FQADAPTIVE:
+            value_setter = new UserValueSetter();
+            value_setter->initialize("Adaptive Sweep", adaptive_sweep, 0, 1);
+            break;
         case MOPT_Z0:
             value_setter = new UserValueSetter();
             value_setter->initialize("Z0", analyzer.z0_, 1, 999);
             break;
         case MOPT_CALIBRATE:
-            calibration_len = step_count;
+        case MOPT_RECALIBRATE:
+            build_sweep_plan();
+            // recalibrating keeps points the plan shares with the calibration
+            sweep_plan.relate(&analyzer);
+            calibration_len = sweep_plan.len();
             calibrator = new Calibrator(&analyzer);
             if(calibrator == NULL) {
                 loop_logger.error("could not make a Calibrator");
             }
-            calibrator->initialize(start_fq, end_fq, step_count, calibration_results);
+            calibrator->initialize(&sweep_plan, calibration_results, option_id == MOPT_RECALIBRATE);
             break;
         case MOPT_SWR: {
-            graph_context = new GraphContext(analysis_results, analysis_results_len, &analyzer);
+            graph_context = new GraphContext(update_derived_results(), &analyzer);
             if(graph_context == NULL) {
                 loop_logger.error("could not make a GraphContext");
             }
@@ -505,7 +739,7 @@ void enter_option(int32_t option_id) {
             break;
         }
         case MOPT_SMITH: {
-            graph_context = new GraphContext(analysis_results, analysis_results_len, &analyzer);
+            graph_context = new GraphContext(update_derived_results(), &analyzer);
             if(graph_context == NULL) {
                 loop_logger.error("could not make a GraphContext");
             }
@@ -520,7 +754,7 @@ void enter_option(int32_t option_id) {
             if(file_browser == NULL) {
                 loop_logger.error("could not make a FileBrowser");
             }
-            file_browser->initialize(&persistence.results_dir_, true);
+            file_browser->initialize(&persistence.results_manifest_, true);
             confirm_dialog = new ConfirmDialog();
             if(confirm_dialog == NULL) {
                 loop_logger.error("could not make a ConfirmDialog");
@@ -532,7 +766,7 @@ void enter_option(int32_t option_id) {
             if(file_browser == NULL) {
                 loop_logger.error("could not make a FileBrowser");
             }
-            file_browser->initialize(&persistence.results_dir_, false);
+            file_browser->initialize(&persistence.results_manifest_, false);
             confirm_dialog = new ConfirmDialog();
             if(confirm_dialog == NULL) {
                 loop_logger.error("could not make a ConfirmDialog");
@@ -544,7 +778,7 @@ void enter_option(int32_t option_id) {
             if(file_browser == NULL) {
                 loop_logger.error("could not make a FileBrowser");
             }
-            file_browser->initialize(&persistence.settings_dir_, true);
+            file_browser->initialize(&persistence.settings_manifest_, true);
             confirm_dialog = new ConfirmDialog();
             if(confirm_dialog == NULL) {
                 loop_logger.error("could not make a ConfirmDialog");
@@ -556,7 +790,7 @@ void enter_option(int32_t option_id) {
             if(file_browser == NULL) {
                 loop_logger.error("could not make a FileBrowser");
             }
-            file_browser->initialize(&persistence.settings_dir_, false);
+            file_browser->initialize(&persistence.settings_manifest_, false);
             confirm_dialog = new ConfirmDialog();
             if(confirm_dialog == NULL) {
                 loop_logger.error("could not make a ConfirmDialog");
@@ -567,6 +801,19 @@ void enter_option(int32_t option_id) {
             value_setter = new UserValueSetter();
             value_setter->initialize("Zoom Smith Chart", zoom_smith, 0, 1);
             break;
+        case MOPT_CAL_INTERP:
+            value_setter = new UserValueSetter();
+            value_setter->initialize("Cubic Cal Interp", analyzer.interpolation_ == CAL_INTERP_CUBIC, 0, 1);
+            break;
+        case MOPT_AVG_SAMPLES:
+            value_setter = new UserValueSetter();
+            value_setter->initialize("Averaging", analyzer.average_samples_, 1, AVERAGE_MAX_SAMPLES);
+            break;
+        case MOPT_AVG_TOLERANCE:
+            // in tenths of a percent
+            value_setter = new UserValueSetter();
+            value_setter->initialize("Avg Tolerance 0.1%", round(analyzer.average_tolerance_*1000), 1, 100);
+            break;
     }
 }
 
@@ -587,6 +834,7 @@ void leave_option(int32_t option_id) {
             int32_t cntFq = start_fq + (end_fq - start_fq)/2;
             start_fq = constrain(cntFq - fq_setter->fq()/2, MIN_FQ, MAX_FQ);
             end_fq = constrain(cntFq + fq_setter->fq()/2, MIN_FQ, MAX_FQ);
+            plan_segment_count = 0;
             delete fq_setter;
             fq_setter = NULL;
             break;
@@ -595,6 +843,7 @@ void leave_option(int32_t option_id) {
             loop_logger.info(String("setting start fq to: ") + fq_setter->fq());
             start_fq = fq_setter->fq();
             end_fq = constrain(end_fq, start_fq+1, MAX_FQ);
+            plan_segment_count = 0;
             delete fq_setter;
             fq_setter = NULL;
             break;
@@ -602,12 +851,25 @@ void leave_option(int32_t option_id) {
             loop_logger.info(String("setting end fq to: ") + fq_setter->fq());
             end_fq = fq_setter->fq();
             start_fq = constrain(start_fq, MIN_FQ, end_fq-1);
+            plan_segment_count = 0;
             delete fq_setter;
             fq_setter = NULL;
             break;
         case MOPT_FQBAND:
             band_setter->band(&start_fq, &end_fq);
             loop_logger.info(String("setting start/end to: ") + start_fq + "/" + end_fq);
+            plan_segment_count = 0;
+            delete band_setter;
+            band_setter = NULL;
+            break;
+        case MOPT_FQBANDS:
+            plan_segment_count = band_setter->segments(plan_segments, MAX_PLAN_SEGMENTS);
+            loop_logger.info(String("setting ")+plan_segment_count+" band segments");
+            if(plan_segment_count > 0) {
+                // keep the title and anything else using the range sensible
+                start_fq = plan_segments[0].start_fq;
+                end_fq = plan_segments[plan_segment_count-1].end_fq;
+            }
             delete band_setter;
             band_setter = NULL;
             break;
@@ -617,32 +879,48 @@ void leave_option(int32_t option_id) {
             delete value_setter;
             value_setter = NULL;
             break;
+        case MOPT_FQSPACING:
+            loop_logger.info(String("setting linear steps: ") + value_setter->value_);
+            plan_spacing = value_setter->value_ ? PLAN_LINEAR : PLAN_LOG;
+            delete value_setter;
+            value_setter = NULL;
+            break;
+        case MOPT_FQADAPTIVE:
+            loop_logger.info(String("setting adaptive sweep: ") + value_setter->value_);
+            adaptive_sweep = value_setter->value_;
+            delete value_setter;
+            value_setter = NULL;
+            break;
         case MOPT_Z0:
             loop_logger.info(String("setting z0 to: ") + value_setter->value_);
             analyzer.z0_ = value_setter->value_;
+            analyzer.calibration_changed();
             delete value_setter;
             value_setter = NULL;
             break;
         case MOPT_ANALYZE:
             delete analysis_processor;
             analysis_processor = NULL;
+            analysis_results_generation++;
             break;
         case MOPT_CALIBRATE:
+        case MOPT_RECALIBRATE:
             delete calibrator;
             calibrator = NULL;
             analyzer.calibration_len_ = calibration_len;
+            analyzer.calibration_changed();
             break;
         case MOPT_SAVE_RESULTS:
             if(confirm_dialog->confirm()) {
                 if(file_browser->is_new()) {
-                    if(!persistence.save_results(analysis_results, analysis_results_len)) {
+                    if(!persistence.save_results(&analysis_results, &analyzer)) {
                         loop_logger.error(F("could not save results"));
                         current_error("could not save results");
                     }
                 } else {
                     char filename[128];
                     file_browser->file(filename, sizeof(filename));
-                    if(!persistence.save_results(filename, analysis_results, analysis_results_len)) {
+                    if(!persistence.save_results(filename, &analysis_results, &analyzer)) {
                         loop_logger.error(F("could not save results"));
                         current_error("could not save results");
                     }
@@ -660,10 +938,11 @@ void leave_option(int32_t option_id) {
             if(confirm_dialog->confirm()) {
                 char filename[128];
                 file_browser->file(filename, sizeof(filename));
-                if(!persistence.load_results(filename, analysis_results, &analysis_results_len, MAX_STEPS)) {
+                if(!persistence.load_results(filename, &analysis_results)) {
                     loop_logger.error(F("could not load results"));
                     current_error("could not load results");
                 }
+                analysis_results_generation++;
             } else {
                 loop_logger.info(F("cancelled loading results"));
                 current_error("cancelled loading results");
@@ -722,6 +1001,25 @@ void leave_option(int32_t option_id) {
             delete value_setter;
             value_setter = NULL;
             break;
+        case MOPT_CAL_INTERP:
+            loop_logger.info(String("setting cubic cal interpolation: ") + value_setter->value_);
+            analyzer.interpolation_ = value_setter->value_ ? CAL_INTERP_CUBIC : CAL_INTERP_LINEAR;
+            analyzer.calibration_changed();
+            delete value_setter;
+            value_setter = NULL;
+            break;
+        case MOPT_AVG_SAMPLES:
+            loop_logger.info(String("setting averaging to: ") + value_setter->value_);
+            analyzer.average_samples_ = value_setter->value_;
+            delete value_setter;
+            value_setter = NULL;
+            break;
+        case MOPT_AVG_TOLERANCE:
+            loop_logger.info(String("setting averaging tolerance to: ") + value_setter->value_);
+            analyzer.average_tolerance_ = value_setter->value_ / 1000.0;
+            delete value_setter;
+            value_setter = NULL;
+            break;
         case MOPT_SWR:
             delete graph_context;
             graph_context = NULL;
@@ -730,6 +1028,18 @@ void leave_option(int32_t option_id) {
             delete graph_context;
             graph_context = NULL;
             break;
+        case MOPT_MONITOR:
+            monitor->finish();
+            delete monitor;
+            monitor = NULL;
+            delete monitor_screen;
+            monitor_screen = NULL;
+            break;
+        case MOPT_LIVE_SWR:
+        case MOPT_LIVE_SMITH:
+            stop_live();
+            analysis_results_generation++;
+            break;
     }
 }
 
@@ -758,8 +1068,37 @@ void handle_option() {
             menu_manager.collapse();
             menu_back();
             break;
+        case MOPT_MONITOR:
+            if (click) {
+                menu_back();
+            } else if (turn != 0) {
+                // steps of 0.1% but at least 1kHz
+                int32_t step = max(monitor_fq/1000, (uint32_t)1000);
+                monitor_fq = constrain((int32_t)monitor_fq + turn*step, MIN_FQ, MAX_FQ);
+                monitor->initialize(monitor_fq);
+                draw_monitor_title();
+            } else if (monitor->poll()) {
+                monitor_screen->draw_reading(monitor->reading());
+            }
+            break;
+        case MOPT_LIVE_SWR:
+        case MOPT_LIVE_SMITH:
+            if (click) {
+                menu_back();
+            } else if (turn != 0) {
+                // fewer points trade resolution for refresh rate
+                live_steps = constrain((int32_t)live_steps + turn, 2, MAX_STEPS);
+                stop_live();
+                start_live(menu_manager.current_option_ == MOPT_LIVE_SMITH);
+            } else {
+                live_sweep->live_step();
+            }
+            break;
         case MOPT_ANALYZE:
-            if (analysis_processor->analyze()) {
+            if (click) {
+                analysis_processor->cancel();
+                menu_back();
+            } else if (analysis_processor->analyze()) {
                 menu_back();
                 if(!menu_manager.select_option(MOPT_SWR)) {
                     loop_logger.error(F("could not find SWR option"));
@@ -771,7 +1110,7 @@ void handle_option() {
         case MOPT_SWR:
             if (click) {
                 menu_back();
-            } else if (turn != 0 && analysis_results_len > 0) {
+            } else if (turn != 0 && analysis_results.len_ > 0) {
                 // move the "pointer" on the swr graph
                 graph_context->incr_swri(turn);
                 graph_context->draw_swr_pointer();
@@ -781,7 +1120,7 @@ void handle_option() {
         case MOPT_SMITH:
             if (click) {
                 menu_back();
-            } else if (turn != 0 && analysis_results_len > 0) {
+            } else if (turn != 0 && analysis_results.len_ > 0) {
                 // move the "pointer" on the smith chart
                 graph_context->incr_swri(turn);
                 graph_context->draw_smith_pointer();
@@ -821,12 +1160,20 @@ void handle_option() {
                 menu_back();
             }
             break;
+        case MOPT_FQBANDS:
+            if (band_setter->set_bands()) {
+                menu_back();
+            }
+            break;
         case MOPT_FQSTEPS:
+        case MOPT_FQSPACING:
+        case MOPT_FQADAPTIVE:
             if(value_setter->set_value()) {
                 menu_back();
             }
             break;
-        case MOPT_CALIBRATE: {
+        case MOPT_CALIBRATE:
+        case MOPT_RECALIBRATE: {
             if(calibrator->calibration_step()) {
                 menu_back();
             }
@@ -838,6 +1185,9 @@ void handle_option() {
             }
             break;
         case MOPT_ZOOM_SMITH:
+        case MOPT_CAL_INTERP:
+        case MOPT_AVG_SAMPLES:
+        case MOPT_AVG_TOLERANCE:
             if(value_setter->set_value()) {
                 menu_back();
             }
@@ -908,6 +1258,55 @@ void setPinOutput(uint8_t pin)
 //TODO: refactor things so we don't have to include shell.h here
 #include "shell.h"
 
+// everything loop() does is one of these tasks, see setup() for their
+// timing
+
+void input_task() {
+    debounced_input.readTransitionsState();
+    if (debounced_input.transitions > 0 && !debounced_input.digitalRead()) {
+        pending_click = true;
+    }
+    uint16_t next_quad_enc = quad_enc.read(32768);
+    pending_turn += next_quad_enc - last_quad_enc;
+}
+
+// menus, measurement and drawing all happen in short steps per option
+void option_task() {
+    click = pending_click;
+    turn = pending_turn;
+    pending_click = false;
+    pending_turn = 0;
+
+    if(click && error_message[0]) {
+        //clear errors on positive user interaction
+        clear_error_display();
+    }
+    handle_option();
+}
+
+void shell_task() {
+    if(read_serial_command()) {
+        handle_serial_command();
+        serial_command_len = 0;
+    }
+}
+
+void battery_task() {
+    update_vbatt();
+    draw_vbatt();
+}
+
+void start_tasks() {
+    // name, function, priority, period ms, deadline ms, budget us
+    scheduler.add("input", input_task, 0, 5, 5, 2000);
+    scheduler.add("option", option_task, 1, 1, 20, 20000);
+    scheduler.add("shell", shell_task, 2, 10, 50, 5000);
+    scheduler.add("battery", battery_task, 3, BATT_SENSE_PERIOD, 1000, 5000);
+    error_task = scheduler.add("error", clear_error_display, 3, 0, 1000, 5000);
+    screenshot_task = scheduler.add("screenshot", screenshot_step, 4, 0, 100, 20000);
+    shell_monitor_task = scheduler.add("monitor", shell_monitor_step, 4, 0, 100, 20000);
+}
+
 void setup_failed() {
     int led_state = 0;
     while(1) {
@@ -1002,11 +1401,8 @@ void setup() {
     debounced_input.readTransitionsState();
 
     loop_logger.info(F("setting some initial start/end fq"));
-    {
-        BandSetter bs;
-        start_fq = bs.band_fqs[BAND_10M][0];
-        end_fq = bs.band_fqs[BAND_10M][1];
-    }
+    start_fq = band_fqs[BAND_10M][0];
+    end_fq = band_fqs[BAND_10M][1];
 
     loop_logger.info(F("checking for settings..."));
     if(!persistence.begin()) {
@@ -1020,9 +1416,10 @@ void setup() {
         set_analysis_from_calibration();
         loop_logger.info(F("loaded settings"));
     }
-    if(!persistence.load_results(analysis_results, &analysis_results_len, MAX_STEPS)) {
+    if(!persistence.load_results(&analysis_results)) {
         loop_logger.error(F("could not load existing results"));
     } else {
+        analysis_results_generation++;
         loop_logger.info(F("loaded results"));
     }
 
@@ -1032,39 +1429,13 @@ void setup() {
     tft.fillScreen(BLACK);
     draw_title();
     draw_menu(menu_manager.current_menu_, menu_manager.current_option_);
+
+    start_tasks();
 }
 
 void loop() {
     loop_logger.debug(F("entering loop"));
-    uint32_t now = millis();
-    if (last_vbatt + BATT_SENSE_PERIOD < now) {
-        //loop_logger.debug("updating battery measurement");
-        update_vbatt();
-        draw_vbatt();
-        //loop_logger.debug("battery measurement updated");
-    }
-
-    if (error_message[0] && now - last_error_time > ERROR_MESSAGE_DWELL_TIME) {
-        clear_error_display();
-    }
-
-    debounced_input.readTransitionsState();
-    click = debounced_input.transitions > 0 && !debounced_input.digitalRead();
-
-    if(click && error_message[0]) {
-        //clear errors on positive user interaction
-        clear_error_display();
-    }
-
-    uint16_t next_quad_enc = quad_enc.read(32768);
-    turn = next_quad_enc - last_quad_enc;
-
-    if(read_serial_command()) {
-        handle_serial_command();
-        serial_command_len = 0;
-    }
-
-    handle_option();
+    scheduler.run();
 }
 
 /*